@@ -0,0 +1,361 @@
+#pragma once
+
+#include "ticker_plant.hpp"
+#include "enum_utils.hpp"
+#include "event_log.hpp"
+
+#include <boost/optional.hpp>
+#include <glog/logging.h>
+#include <json/value.h>
+#include <json/reader.h>
+#include <json/writer.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+namespace btc_arb {
+
+// A venue is described by a traits struct holding constexpr tables instead of
+// a hand-written parser:
+//
+//   struct Venue {
+//     static constexpr const char* name = "...";
+//     static constexpr const char* channel_key = "channel";
+//     static constexpr ChannelDef channels[] = {{"<id>", ChannelKind::TRADE}, ...};
+//     static constexpr TradeFields trade_fields = {...};
+//     static constexpr QuoteFields quote_fields = {...};
+//     static constexpr const char* trade_types[] = {...};  // by Trade::Type
+//     static constexpr const char* quote_types[] = {...};  // by Quote::Type
+//   };
+//
+// and JsonFeedParser<Venue> is then used wherever a Parser is expected.
+
+enum class ChannelKind { TRADE, DEPTH, TICKER };
+
+struct ChannelDef {
+  const char* id;
+  ChannelKind kind;
+};
+
+// JSON keys of each Tick field. Fields live in the `body` object except
+// ex_time, which is read from the message root.
+struct TradeFields {
+  const char* ex_time;
+  const char* body;
+  const char* type;
+  const char* amount;
+  const char* amount_int;
+  const char* currency;
+  const char* price;
+  const char* price_int;
+};
+
+struct QuoteFields {
+  const char* ex_time;
+  const char* body;
+  const char* type;
+  const char* delta_volume;
+  const char* delta_volume_int;
+  const char* total_volume_int;
+  const char* currency;
+  const char* price;
+  const char* price_int;
+};
+
+constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+constexpr uint32_t MAX_SEED_TRIES = 128;
+
+constexpr uint32_t fnv1a(const char* str, size_t len,
+                         uint32_t hash = FNV_OFFSET_BASIS) {
+  return len == 0 ? hash
+      : fnv1a(str + 1, len - 1,
+              (hash ^ static_cast<uint8_t>(*str)) * FNV_PRIME);
+}
+
+// Runtime twin of fnv1a(), kept iterative for unoptimised builds.
+inline uint32_t fnv1a_hash(const char* str, size_t len,
+                           uint32_t hash = FNV_OFFSET_BASIS) {
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(str[i])) * FNV_PRIME;
+  }
+  return hash;
+}
+
+constexpr size_t const_strlen(const char* str) {
+  return *str == '\0' ? 0 : 1 + const_strlen(str + 1);
+}
+
+constexpr size_t next_pow2(size_t n, size_t p = 1) {
+  return p >= n ? p : next_pow2(n, p * 2);
+}
+
+template<typename Venue>
+constexpr size_t num_channels() {
+  return sizeof(Venue::channels) / sizeof(Venue::channels[0]);
+}
+
+template<typename Venue>
+constexpr size_t channel_table_size() {
+  return next_pow2(2 * num_channels<Venue>());
+}
+
+template<typename Venue>
+constexpr size_t channel_slot(uint32_t seed, size_t i) {
+  return fnv1a(Venue::channels[i].id, const_strlen(Venue::channels[i].id), seed)
+      & (channel_table_size<Venue>() - 1);
+}
+
+template<typename Venue>
+constexpr bool channel_collides(uint32_t seed, size_t i, size_t j) {
+  return j == num_channels<Venue>() ? false
+      : channel_slot<Venue>(seed, i) == channel_slot<Venue>(seed, j) ||
+        channel_collides<Venue>(seed, i, j + 1);
+}
+
+template<typename Venue>
+constexpr bool channels_perfect(uint32_t seed, size_t i = 0) {
+  return i == num_channels<Venue>() ? true
+      : !channel_collides<Venue>(seed, i, i + 1) &&
+        channels_perfect<Venue>(seed, i + 1);
+}
+
+template<typename Venue>
+constexpr uint32_t find_channel_seed(uint32_t seed = FNV_OFFSET_BASIS,
+                                     uint32_t tries = MAX_SEED_TRIES) {
+  return channels_perfect<Venue>(seed) || tries == 0 ? seed
+      : find_channel_seed<Venue>(seed + 1, tries - 1);
+}
+
+template<typename Venue>
+constexpr int channel_slot_owner(uint32_t seed, size_t slot, size_t i = 0) {
+  return i == num_channels<Venue>() ? -1
+      : channel_slot<Venue>(seed, i) == slot ? static_cast<int>(i)
+      : channel_slot_owner<Venue>(seed, slot, i + 1);
+}
+
+template<size_t... Is> struct IndexList {};
+template<size_t N, size_t... Is>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, Is...> {};
+template<size_t... Is>
+struct MakeIndexList<0, Is...> { using type = IndexList<Is...>; };
+
+// Perfect hash from channel id to ChannelDef, seeded and laid out entirely at
+// compile time. A lookup is one hash and one string compare.
+template<typename Venue,
+         typename Indices = typename MakeIndexList<channel_table_size<Venue>()>::type>
+class ChannelTable;
+
+template<typename Venue, size_t... Is>
+class ChannelTable<Venue, IndexList<Is...>> {
+ public:
+  static constexpr uint32_t SEED = find_channel_seed<Venue>();
+  static_assert(channels_perfect<Venue>(SEED),
+                "no collision-free seed found for the venue's channels");
+
+  static inline const ChannelDef* find(const char* id, size_t len) {
+    const int owner =
+        slots_[fnv1a_hash(id, len, SEED) & (sizeof...(Is) - 1)];
+    if (owner < 0) {
+      return nullptr;
+    }
+    const ChannelDef& def = Venue::channels[owner];
+    if (std::strncmp(def.id, id, len) != 0 || def.id[len] != '\0') {
+      return nullptr;
+    }
+    return &def;
+  }
+
+ private:
+  static constexpr int slots_[sizeof...(Is)] = {
+    channel_slot_owner<Venue>(SEED, Is)...
+  };
+};
+
+template<typename Venue, size_t... Is>
+constexpr uint32_t ChannelTable<Venue, IndexList<Is...>>::SEED;
+
+template<typename Venue, size_t... Is>
+constexpr int ChannelTable<Venue, IndexList<Is...>>::slots_[sizeof...(Is)];
+
+// Generic parser driven by the Venue tables; satisfies the same protocol as
+// FlatParser so it plugs into WebSocketTickerPlant and FileTickerPlant.
+template<typename Venue>
+class JsonFeedParser {
+ public:
+  JsonFeedParser() : parse_failures_(PlantMetrics::instance().parse_failures) {}
+ protected:
+  inline boost::optional<const ParsedTick> parse(
+      std::istream& stream, uint64_t received = 0);
+ private:
+  inline boost::optional<Tick> parse_trade(
+      const Json::Value& root, uint64_t received);
+  inline boost::optional<Tick> parse_depth(
+      const Json::Value& root, uint64_t received);
+
+  template<typename EnumType, size_t N>
+  static inline EnumType read_type(
+      const Json::Value& value, const char* const (&names)[N]);
+  static inline Currency read_currency(const Json::Value& value);
+  static inline double read_double(const Json::Value& value);
+  static inline int64_t read_int64(const Json::Value& value);
+  static inline uint64_t read_uint64(const Json::Value& value);
+
+  Json::Reader reader_;
+  Json::FastWriter writer_;
+  std::string msg_;
+  Counter& parse_failures_;
+};
+
+template<typename Venue>
+boost::optional<const ParsedTick> JsonFeedParser<Venue>::parse(
+    std::istream& stream, uint64_t received) {
+  Json::Value root;
+  std::getline(stream, msg_);
+  if (!reader_.parse(msg_, root)) {
+    EVENT_LOG(WARNING, "Could not parse {} tick ({})", Venue::name,
+              reader_.getFormattedErrorMessages());
+    parse_failures_.inc();
+    return boost::optional<const ParsedTick>();
+  }
+  if (received == 0) {
+    received = std::chrono::system_clock::now().time_since_epoch().count();
+  }
+  if (root.get("_received", 0).asUInt64() == 0) {
+    root["_received"] = Json::Value{static_cast<Json::UInt64>(received)};
+  }
+  const Json::Value& channel =
+      static_cast<const Json::Value&>(root)[Venue::channel_key];
+  const char* channel_id = channel.isString() ? channel.asCString() : "";
+  const ChannelDef* def =
+      ChannelTable<Venue>::find(channel_id, std::strlen(channel_id));
+  boost::optional<Tick> tick;
+  if (def == nullptr) {
+    EVENT_LOG(WARNING, "Unknown {} channel \'{}\'", Venue::name, channel_id);
+    parse_failures_.inc();
+  } else if (def->kind == ChannelKind::TRADE) {
+    tick = parse_trade(root, received);
+  } else if (def->kind == ChannelKind::DEPTH) {
+    tick = parse_depth(root, received);
+  }
+  if (tick) {
+    return boost::optional<const ParsedTick>(ParsedTick{*tick, writer_.write(root)});
+  }
+  return boost::optional<const ParsedTick>();
+}
+
+template<typename Venue>
+boost::optional<Tick> JsonFeedParser<Venue>::parse_trade(
+    const Json::Value& root, const uint64_t received) {
+  const TradeFields& f = Venue::trade_fields;
+  try {
+    const Json::Value& body = root[f.body];
+    return boost::optional<Tick>(Trade{
+        received,
+        read_uint64(root[f.ex_time]),
+        read_type<Trade::Type>(body[f.type], Venue::trade_types),
+        read_double(body[f.amount]),
+        read_int64(body[f.amount_int]),
+        read_currency(body[f.currency]),
+        read_double(body[f.price]),
+        static_cast<int32_t>(read_int64(body[f.price_int]))});
+  } catch (const std::exception& e) {
+    EVENT_LOG(WARNING, "Could not parse {} trade ({})", Venue::name, e.what());
+    parse_failures_.inc();
+    return boost::optional<Tick>();
+  }
+}
+
+template<typename Venue>
+boost::optional<Tick> JsonFeedParser<Venue>::parse_depth(
+    const Json::Value& root, const uint64_t received) {
+  const QuoteFields& f = Venue::quote_fields;
+  try {
+    const Json::Value& body = root[f.body];
+    const int64_t total_volume_int{read_int64(body[f.total_volume_int])};
+    return boost::optional<Tick>(Quote{
+        received,
+        read_uint64(root[f.ex_time]),
+        read_type<Quote::Type>(body[f.type], Venue::quote_types),
+        read_double(body[f.delta_volume]),
+        read_int64(body[f.delta_volume_int]),
+        static_cast<double>(total_volume_int) / VOLUME_MULTIPLIER,
+        total_volume_int,
+        read_currency(body[f.currency]),
+        read_double(body[f.price]),
+        static_cast<int32_t>(read_int64(body[f.price_int]))});
+  } catch (const std::exception& e) {
+    EVENT_LOG(WARNING, "Could not parse {} depth ({})", Venue::name, e.what());
+    parse_failures_.inc();
+    return boost::optional<Tick>();
+  }
+}
+
+// Strings are matched against the venue's names for each enumerator;
+// integers are taken as 1-based positions in the same table.
+template<typename Venue>
+template<typename EnumType, size_t N>
+EnumType JsonFeedParser<Venue>::read_type(
+    const Json::Value& value, const char* const (&names)[N]) {
+  int index = -1;
+  if (value.isString()) {
+    const char* str = value.asCString();
+    index = name_index(names, str, std::strlen(str));
+  } else if (value.isIntegral()) {
+    index = value.asInt() - 1;
+  }
+  if (index < 0 || index >= static_cast<int>(N)) {
+    throw std::runtime_error("unknown type \'" + value.toStyledString() + "\'");
+  }
+  return static_cast<EnumType>(index);
+}
+
+template<typename Venue>
+Currency JsonFeedParser<Venue>::read_currency(const Json::Value& value) {
+  Currency cyc;
+  const char* str = value.isString() ? value.asCString() : "";
+  if (!enum_from_chars(str, std::strlen(str), cyc)) {
+    throw std::runtime_error("unknown currency \'" + std::string(str) + "\'");
+  }
+  return cyc;
+}
+
+template<typename Venue>
+double JsonFeedParser<Venue>::read_double(const Json::Value& value) {
+  if (value.isString()) {
+    return std::stod(value.asString());
+  }
+  if (!value.isNumeric()) {
+    throw std::runtime_error("missing numeric field");
+  }
+  return value.asDouble();
+}
+
+template<typename Venue>
+int64_t JsonFeedParser<Venue>::read_int64(const Json::Value& value) {
+  if (value.isString()) {
+    return std::stoll(value.asString());
+  }
+  if (!value.isIntegral()) {
+    throw std::runtime_error("missing integer field");
+  }
+  return value.asInt64();
+}
+
+template<typename Venue>
+uint64_t JsonFeedParser<Venue>::read_uint64(const Json::Value& value) {
+  if (value.isString()) {
+    return std::stoull(value.asString());
+  }
+  if (!value.isIntegral()) {
+    throw std::runtime_error("missing integer field");
+  }
+  return value.asUInt64();
+}
+
+}  // namespace btc_arb
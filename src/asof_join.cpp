@@ -0,0 +1,137 @@
+#include "asof_join.hpp"
+
+#include <glog/logging.h>
+
+#include <limits>
+#include <stdexcept>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+constexpr size_t AsOfSink::BUFFER_SIZE;
+
+AsOfSink::AsOfSink(const string& path, uint32_t num_right)
+    : path_(path), record_size_(sizeof(Tick) + num_right * sizeof(AsOfQuote)),
+      buffer_(max(BUFFER_SIZE, record_size_)) {
+  file_.open(path, ios::out | ios::binary | ios::trunc);
+  CHECK (file_.is_open()) << "could not open " << path;
+  const uint32_t header[2] = {num_right, 0};
+  file_.write(ASOF_JOIN_MAGIC, sizeof(ASOF_JOIN_MAGIC) - 1);
+  file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+  check();
+}
+
+AsOfSink::~AsOfSink() {
+  if (!file_.is_open()) {
+    return;
+  }
+  try {
+    close();
+  } catch (const exception& e) {
+    LOG(ERROR) << e.what();
+  }
+}
+
+void AsOfSink::flush() {
+  file_.write(buffer_.data(), used_);
+  used_ = 0;
+  check();
+}
+
+void AsOfSink::close() {
+  flush();
+  file_.close();
+  check();
+}
+
+void AsOfSink::check() {
+  if (file_.fail()) {
+    throw runtime_error("could not write " + path_);
+  }
+}
+
+AsOfJoin::AsOfJoin(const TickStore& left, const vector<const TickStore*>& right,
+                   const AsOfJoinConfig& config)
+    : left_(left), right_(right), config_(config), sources_(right.size()) {}
+
+void AsOfJoin::apply(Source& source, const Tick& tick) {
+  if (tick.type == Tick::Type::QUOTE) {
+    const Quote& quote = tick.as<Quote>();
+    const size_t cyc = static_cast<size_t>(quote.cyc);
+    source.books.apply(quote);
+    AsOfQuote& top = source.quotes[cyc];
+    if (quote.type == Quote::Type::BID_UPDATE) {
+      const BookSet::Side& bids = source.books.bids[cyc];
+      top.bid_price_int = bids.empty() ? 0 : bids.rbegin()->first;
+      top.bid_volume_int = bids.empty() ? 0 : bids.rbegin()->second;
+    } else {
+      const BookSet::Side& asks = source.books.asks[cyc];
+      top.ask_price_int = asks.empty() ? 0 : asks.begin()->first;
+      top.ask_volume_int = asks.empty() ? 0 : asks.begin()->second;
+    }
+    top.time = quote.received;
+  } else if (tick.type == Tick::Type::TRADE) {
+    const Trade& trade = tick.as<Trade>();
+    AsOfQuote& top = source.quotes[static_cast<size_t>(trade.cyc)];
+    top.last_price_int = trade.price_int;
+    top.last_amount_int = trade.amount_int;
+    top.last_trade_type = static_cast<int32_t>(trade.type);
+    top.time = trade.received;
+  }
+}
+
+uint64_t AsOfJoin::run(AsOfSink& sink) {
+  const size_t num_right = right_.size();
+  vector<TickStore::Reader> readers;
+  for (const TickStore* store : right_) {
+    readers.emplace_back(*store);
+  }
+  TickStore::Reader left{left_};
+  vector<AsOfQuote> joined(num_right);
+  uint64_t written = 0;
+
+  constexpr uint64_t END = numeric_limits<uint64_t>::max();
+  vector<uint64_t> heads(num_right);
+  for (size_t r = 0; r < num_right; ++r) {
+    heads[r] = readers[r].peek() ? tick_received(*readers[r].peek()) : END;
+  }
+
+  while (const Tick* tick = left.peek()) {
+    const uint64_t time = tick_received(*tick);
+    // Bring every right source up to the left tick, ties included.
+    for (size_t r = 0; r < num_right; ++r) {
+      TickStore::Reader& reader = readers[r];
+      while (heads[r] <= time) {
+        apply(sources_[r], *reader.peek());
+        ++ticks_read_;
+        reader.advance();
+        heads[r] = reader.peek() ? tick_received(*reader.peek()) : END;
+      }
+    }
+    ++ticks_read_;
+
+    if (tick->type != Tick::Type::EMPTY &&
+        (config_.left_type == Tick::Type::EMPTY ||
+         tick->type == config_.left_type) &&
+        (config_.currencies & (1u << static_cast<uint32_t>(tick_currency(*tick))))) {
+      const size_t cyc = static_cast<size_t>(tick_currency(*tick));
+      for (size_t r = 0; r < num_right; ++r) {
+        const AsOfQuote& quote = sources_[r].quotes[cyc];
+        if (quote.time != 0 && time - quote.time <= config_.tolerance) {
+          joined[r] = quote;
+        } else {
+          joined[r] = AsOfQuote{};
+        }
+      }
+      sink.write(*tick, joined.data());
+      ++written;
+    }
+    left.advance();
+  }
+  sink.flush();
+  return written;
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "book_set.hpp"
+#include "ticker_plant.hpp"
+#include "tick_store.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Joined output: the magic, uint32 number of right sources R, uint32 zero,
+// then one record per left tick: the Tick followed by R AsOfQuotes.
+constexpr char ASOF_JOIN_MAGIC[] = "BTCASOF1";
+
+// One right-hand source as of a left tick, on the left tick's currency.
+// All zero if the source had no update within the tolerance.
+struct AsOfQuote {
+  uint64_t time;  // receive time of the source's last update
+  int64_t bid_volume_int;
+  int64_t ask_volume_int;
+  int64_t last_amount_int;
+  int32_t bid_price_int;  // best bid, 0 if the bid side is empty
+  int32_t ask_price_int;  // best ask, 0 if the ask side is empty
+  int32_t last_price_int;  // last trade, 0 if none yet
+  int32_t last_trade_type;  // Trade::Type of the last trade
+};
+
+struct AsOfJoinConfig {
+  // Right sources whose last update is older than this (ns) do not match.
+  uint64_t tolerance = 1000000000;
+  // Left ticks joined; Tick::Type::EMPTY joins every tick.
+  Tick::Type left_type = Tick::Type::TRADE;
+  uint32_t currencies = ~0u;  // bit per Currency
+};
+
+// Buffered writer of the joined output format. Write errors (e.g. a full
+// disk) throw std::runtime_error from flush() and close(); the destructor
+// can only log them.
+class AsOfSink {
+ public:
+  AsOfSink(const std::string& path, uint32_t num_right);
+  ~AsOfSink();
+  AsOfSink(const AsOfSink&) = delete;
+
+  inline void write(const Tick& left, const AsOfQuote* right);
+  void flush();
+  void close();
+
+ private:
+  static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+  void check();
+
+  const std::string path_;
+  std::ofstream file_;
+  const size_t record_size_;
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+};
+
+void AsOfSink::write(const Tick& left, const AsOfQuote* right) {
+  if (used_ + record_size_ > buffer_.size()) {
+    flush();
+  }
+  char* record = buffer_.data() + used_;
+  std::memcpy(record, &left, sizeof(Tick));
+  std::memcpy(record + sizeof(Tick), right, record_size_ - sizeof(Tick));
+  used_ += record_size_;
+}
+
+// Streaming as-of join: every left tick of the configured type and
+// currencies is written with the top of book and last trade of each right
+// source as of the tick's receive time, on the same currency. Sources are
+// merged by receive time; right updates stamped at the same time as a left
+// tick are applied before it. Memory is bounded by the right sources'
+// books, whatever the length of the inputs.
+class AsOfJoin {
+ public:
+  AsOfJoin(const TickStore& left, const std::vector<const TickStore*>& right,
+           const AsOfJoinConfig& config = AsOfJoinConfig{});
+  AsOfJoin(const AsOfJoin&) = delete;
+
+  // Returns the number of records written.
+  uint64_t run(AsOfSink& sink);
+
+  uint64_t ticks_read() const { return ticks_read_; }
+
+ private:
+  // A right source's books and, per currency, its cached top of book and
+  // last trade.
+  struct Source {
+    BookSet books;
+    AsOfQuote quotes[enum_size<Currency>()] = {};
+  };
+
+  static void apply(Source& source, const Tick& tick);
+
+  const TickStore& left_;
+  const std::vector<const TickStore*> right_;
+  const AsOfJoinConfig config_;
+  std::vector<Source> sources_;  // per right source
+  uint64_t ticks_read_ = 0;
+};
+
+}  // namespace btc_arb
@@ -0,0 +1,278 @@
+#include "asof_join.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+namespace {
+
+constexpr uint64_t TOLERANCE = 1000;
+
+Tick quote(uint64_t received, Currency cyc, Quote::Type type,
+           int32_t price_int, int64_t volume) {
+  Quote quote{};
+  quote.received = received;
+  quote.type = type;
+  quote.total_volume_int = volume;
+  quote.cyc = cyc;
+  quote.price_int = price_int;
+  return Tick(quote);
+}
+
+Tick trade(uint64_t received, Currency cyc, int32_t price_int, int64_t amount) {
+  Trade trade{};
+  trade.received = received;
+  trade.type = Trade::Type::BID;
+  trade.amount_int = amount;
+  trade.cyc = cyc;
+  trade.price_int = price_int;
+  return Tick(trade);
+}
+
+std::string temp_path() {
+  char name[] = "/tmp/asof_join_test.XXXXXX";
+  const int fd = mkstemp(name);
+  EXPECT_GE(fd, 0);
+  close(fd);
+  return name;
+}
+
+// Ticks stored in a flat file of their own, removed with the store.
+class TempStore {
+ public:
+  explicit TempStore(const std::vector<Tick>& ticks) {
+    if (!ticks.empty()) {
+      paths_.push_back(temp_path());
+      std::ofstream out(paths_[0], std::ios::out | std::ios::binary);
+      out.write(reinterpret_cast<const char*>(ticks.data()),
+                ticks.size() * sizeof(Tick));
+    }
+    store_.reset(new TickStore(paths_));
+  }
+
+  ~TempStore() {
+    store_.reset();
+    for (const std::string& path : paths_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  const TickStore* store() const { return store_.get(); }
+
+ private:
+  std::vector<std::string> paths_;
+  std::unique_ptr<TickStore> store_;
+};
+
+struct Record {
+  Tick left;
+  std::vector<AsOfQuote> right;
+};
+
+class AsOfJoinTest : public ::testing::Test {
+ protected:
+  AsOfJoinTest() : out_path_(temp_path()) {}
+  ~AsOfJoinTest() { std::remove(out_path_.c_str()); }
+
+  // Joins and reads the output back.
+  std::vector<Record> join(const std::vector<Tick>& left,
+                           const std::vector<std::vector<Tick>>& right,
+                           const AsOfJoinConfig& config = tolerance_config()) {
+    TempStore left_store(left);
+    std::vector<std::unique_ptr<TempStore>> right_stores;
+    std::vector<const TickStore*> stores;
+    for (const std::vector<Tick>& ticks : right) {
+      right_stores.emplace_back(new TempStore(ticks));
+      stores.push_back(right_stores.back()->store());
+    }
+    {
+      AsOfSink sink(out_path_, right.size());
+      AsOfJoin join(*left_store.store(), stores, config);
+      written_ = join.run(sink);
+      sink.close();
+    }
+
+    std::ifstream in(out_path_, std::ios::binary);
+    const std::string data{std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>()};
+    const size_t magic = sizeof(ASOF_JOIN_MAGIC) - 1;
+    EXPECT_EQ(std::string(ASOF_JOIN_MAGIC), data.substr(0, magic));
+    uint32_t header[2];
+    std::memcpy(header, data.data() + magic, sizeof(header));
+    EXPECT_EQ(right.size(), header[0]);
+    const size_t record_size = sizeof(Tick) + right.size() * sizeof(AsOfQuote);
+    const size_t begin = magic + sizeof(header);
+    EXPECT_EQ(0u, (data.size() - begin) % record_size);
+
+    std::vector<Record> records;
+    for (size_t at = begin; at + record_size <= data.size(); at += record_size) {
+      Record record;
+      std::memcpy(&record.left, data.data() + at, sizeof(Tick));
+      record.right.resize(right.size());
+      std::memcpy(record.right.data(), data.data() + at + sizeof(Tick),
+                  right.size() * sizeof(AsOfQuote));
+      records.push_back(record);
+    }
+    EXPECT_EQ(written_, records.size());
+    return records;
+  }
+
+  static AsOfJoinConfig tolerance_config() {
+    AsOfJoinConfig config;
+    config.tolerance = TOLERANCE;
+    return config;
+  }
+
+  const std::string out_path_;
+  uint64_t written_ = 0;
+};
+
+TEST_F(AsOfJoinTest, ToleranceIsInclusive) {
+  const std::vector<Tick> left = {
+    trade(1100, Currency::USD, 100, 1),
+    trade(2000, Currency::USD, 100, 1),
+    trade(2001, Currency::USD, 100, 1)};
+  const std::vector<Tick> right = {
+    quote(1000, Currency::USD, Quote::Type::BID_UPDATE, 99, 5)};
+  const std::vector<Record> records = join(left, {right});
+
+  ASSERT_EQ(3u, records.size());
+  EXPECT_EQ(1000u, records[0].right[0].time);
+  EXPECT_EQ(99, records[0].right[0].bid_price_int);
+  EXPECT_EQ(5, records[0].right[0].bid_volume_int);
+  EXPECT_EQ(0, records[0].right[0].ask_price_int);
+  EXPECT_EQ(1000u, records[1].right[0].time);
+  // Older than the tolerance: all zero.
+  EXPECT_EQ(0u, records[2].right[0].time);
+  EXPECT_EQ(0, records[2].right[0].bid_price_int);
+  EXPECT_EQ(0, records[2].right[0].bid_volume_int);
+}
+
+TEST_F(AsOfJoinTest, TiesAreAppliedBeforeLeftTick) {
+  const std::vector<Tick> left = {
+    trade(500, Currency::USD, 100, 1),
+    trade(1000, Currency::USD, 100, 1)};
+  const std::vector<Tick> right = {
+    quote(1000, Currency::USD, Quote::Type::ASK_UPDATE, 101, 3),
+    trade(1000, Currency::USD, 102, 7),
+    quote(1001, Currency::USD, Quote::Type::ASK_UPDATE, 100, 3)};
+  const std::vector<Record> records = join(left, {right});
+
+  ASSERT_EQ(2u, records.size());
+  EXPECT_EQ(0u, records[0].right[0].time);
+  EXPECT_EQ(1000u, records[1].right[0].time);
+  EXPECT_EQ(101, records[1].right[0].ask_price_int);
+  EXPECT_EQ(102, records[1].right[0].last_price_int);
+  EXPECT_EQ(7, records[1].right[0].last_amount_int);
+}
+
+TEST_F(AsOfJoinTest, EmptyRightSources) {
+  const std::vector<Tick> left = {
+    trade(1000, Currency::USD, 100, 1),
+    quote(1001, Currency::USD, Quote::Type::BID_UPDATE, 100, 1),
+    trade(1002, Currency::EUR, 100, 1)};
+  const std::vector<Record> records = join(left, {{}, {}});
+  ASSERT_EQ(2u, records.size());
+  for (const Record& record : records) {
+    for (const AsOfQuote& quote : record.right) {
+      EXPECT_EQ(0u, quote.time);
+      EXPECT_EQ(0, quote.bid_price_int);
+      EXPECT_EQ(0, quote.last_price_int);
+    }
+  }
+
+  // No right sources at all: the left ticks alone.
+  const std::vector<Record> alone = join(left, {});
+  ASSERT_EQ(2u, alone.size());
+  EXPECT_EQ(1002u, tick_received(alone[1].left));
+}
+
+// Every joined quote equals a replay of the right ticks received up to the
+// left tick, on its currency.
+TEST_F(AsOfJoinTest, MatchesReplayOfRightBooks) {
+  std::mt19937 rng(5);
+  std::vector<Tick> left;
+  std::vector<std::vector<Tick>> right(2);
+  uint64_t time = 1000;
+  for (int i = 0; i < 5000; ++i) {
+    time += rng() % 300;
+    const Currency cyc = static_cast<Currency>(rng() % 2);
+    const size_t source = rng() % 3;
+    if (source == 2) {
+      left.push_back(trade(time, cyc, 100, 1));
+    } else if (rng() % 4 == 0) {
+      right[source].push_back(trade(time, cyc, 90 + rng() % 20, 1 + rng() % 9));
+    } else {
+      const bool bid = rng() % 2;
+      right[source].push_back(quote(
+          time, cyc, bid ? Quote::Type::BID_UPDATE : Quote::Type::ASK_UPDATE,
+          bid ? 90 + rng() % 10 : 100 + rng() % 10,
+          rng() % 3 == 0 ? 0 : 1 + rng() % 100));
+    }
+  }
+  const std::vector<Record> records = join(left, right);
+  ASSERT_EQ(left.size(), records.size());
+
+  for (size_t r = 0; r < right.size(); ++r) {
+    BookSet books;
+    AsOfQuote last[enum_size<Currency>()] = {};
+    size_t next = 0;
+    for (const Record& record : records) {
+      const uint64_t at = tick_received(record.left);
+      for (; next < right[r].size() && tick_received(right[r][next]) <= at;
+           ++next) {
+        const Tick& tick = right[r][next];
+        AsOfQuote& state = last[static_cast<size_t>(tick_currency(tick))];
+        state.time = tick_received(tick);
+        if (tick.type == Tick::Type::QUOTE) {
+          books.apply(tick.as<Quote>());
+        } else {
+          state.last_price_int = tick.as<Trade>().price_int;
+          state.last_amount_int = tick.as<Trade>().amount_int;
+        }
+      }
+      const size_t cyc = static_cast<size_t>(tick_currency(record.left));
+      const AsOfQuote& joined = record.right[r];
+      if (last[cyc].time == 0 || at - last[cyc].time > TOLERANCE) {
+        EXPECT_EQ(0u, joined.time);
+        EXPECT_EQ(0, joined.bid_volume_int);
+        continue;
+      }
+      const BookSet::Side& bids = books.bids[cyc];
+      const BookSet::Side& asks = books.asks[cyc];
+      ASSERT_EQ(last[cyc].time, joined.time);
+      EXPECT_EQ(bids.empty() ? 0 : bids.rbegin()->first, joined.bid_price_int);
+      EXPECT_EQ(bids.empty() ? 0 : bids.rbegin()->second, joined.bid_volume_int);
+      EXPECT_EQ(asks.empty() ? 0 : asks.begin()->first, joined.ask_price_int);
+      EXPECT_EQ(asks.empty() ? 0 : asks.begin()->second, joined.ask_volume_int);
+      EXPECT_EQ(last[cyc].last_price_int, joined.last_price_int);
+      EXPECT_EQ(last[cyc].last_amount_int, joined.last_amount_int);
+    }
+  }
+}
+
+TEST(AsOfSinkTest, WriteFailureThrows) {
+  std::ifstream full("/dev/full");
+  if (!full.is_open()) {
+    return;  // no /dev/full here
+  }
+  AsOfSink sink("/dev/full", 1);
+  const Tick tick = trade(1, Currency::USD, 100, 1);
+  const AsOfQuote quote{};
+  sink.write(tick, &quote);
+  EXPECT_THROW(sink.close(), std::runtime_error);
+}
+
+}  // anonymous namespace
+}  // namespace btc_arb
@@ -0,0 +1,130 @@
+#include "asof_join.hpp"
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/program_options.hpp>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace btc_arb;
+
+namespace {
+unique_ptr<TickStore> open_store(const string& paths) {
+  vector<string> files;
+  boost::split(files, paths, boost::is_any_of(","));
+  return unique_ptr<TickStore>{new TickStore(files)};
+}
+}  // anonymous namespace
+
+// Joins the books of one or more right sources onto each tick of a left
+// source, as of the tick's receive time.
+int main(int argc, char **argv) {
+  namespace po = boost::program_options;
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+
+  string left_paths;
+  vector<string> right_paths;
+  string out_path;
+  string left_type{"trade"};
+  vector<string> currencies;
+  uint64_t tolerance_ms{1000};
+
+  stringstream desc_msg;
+  desc_msg << "As-of Join -- writes each left tick with the top of book and "
+           << "last trade of every right source as of that tick" << endl << endl
+           << "usage: " << argv[0] << " --left PATHS --right PATHS... --out PATH"
+           << endl << endl << "Allowed options:";
+
+  auto description = po::options_description{desc_msg.str()};
+  description.add_options()
+      ("help,h", "prints this help message")
+      ("left",
+       po::value<string>(&left_paths)->value_name("PATH[,PATH...]"),
+       "flat tick files of the left source, oldest first")
+      ("right",
+       po::value<vector<string>>(&right_paths)->value_name("PATH[,PATH...]"),
+       "flat tick files of a right source, oldest first; repeat for more sources")
+      ("out",
+       po::value<string>(&out_path)->value_name("PATH"),
+       "joined output file")
+      ("left-type",
+       po::value<string>(&left_type)->value_name("TYPE"),
+       "left ticks to join: trade, quote or any; default=trade")
+      ("currency",
+       po::value<vector<string>>(&currencies)->value_name("CYC"),
+       "left currency to join, e.g. usd; repeat for more; default all")
+      ("tolerance-ms",
+       po::value<uint64_t>(&tolerance_ms)->value_name("MS"),
+       "right updates older than this do not match; default=1000");
+
+  auto variables = po::variables_map{};
+  try {
+    po::store(po::parse_command_line(argc, argv, description), variables);
+    po::notify(variables);
+    if (variables.count("help") || left_paths.empty() || right_paths.empty() ||
+        out_path.empty()) {
+      cerr << description << endl;
+      return 0;
+    }
+
+    AsOfJoinConfig config;
+    config.tolerance = tolerance_ms * 1000000;
+    if (left_type == "trade") {
+      config.left_type = Tick::Type::TRADE;
+    } else if (left_type == "quote") {
+      config.left_type = Tick::Type::QUOTE;
+    } else if (left_type == "any") {
+      config.left_type = Tick::Type::EMPTY;
+    } else {
+      throw runtime_error("invalid left type '" + left_type + "'");
+    }
+    if (!currencies.empty()) {
+      config.currencies = 0;
+      for (const string& name : currencies) {
+        Currency cyc;
+        if (!enum_from_chars(name.data(), name.size(), cyc)) {
+          throw runtime_error("invalid currency '" + name + "'");
+        }
+        config.currencies |= 1u << static_cast<uint32_t>(cyc);
+      }
+    }
+
+    unique_ptr<TickStore> left = open_store(left_paths);
+    vector<unique_ptr<TickStore>> right;
+    vector<const TickStore*> right_stores;
+    for (const string& paths : right_paths) {
+      right.push_back(open_store(paths));
+      right_stores.push_back(right.back().get());
+    }
+
+    AsOfSink sink{out_path, static_cast<uint32_t>(right.size())};
+    AsOfJoin join{*left, right_stores, config};
+    const auto start = chrono::steady_clock::now();
+    const uint64_t written = join.run(sink);
+    sink.close();
+    const double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    LOG(INFO) << "joined " << written << " records from " << join.ticks_read()
+              << " ticks in " << seconds << "s ("
+              << join.ticks_read() / seconds / 1E6 << "M ticks/s)";
+  } catch (const boost::program_options::unknown_option& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  } catch (const boost::program_options::invalid_option_value& e) {
+    LOG(ERROR) << e.what();
+    return 2;
+  } catch(const std::exception& e) {
+    LOG(ERROR) << e.what();
+    return -1;
+  }
+  return 0;
+}
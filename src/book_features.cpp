@@ -0,0 +1,212 @@
+#include "book_features.hpp"
+
+#include <glog/logging.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+BookFeatures::BookFeatures() {
+  memset(&levels_, 0, sizeof(levels_));
+  memset(&features_, 0, sizeof(features_));
+}
+
+size_t BookFeatures::add_venue(const string& name) {
+  CHECK ((venues_.size() + 1) * enum_size<Currency>() <= MAX_FEATURE_BOOKS)
+      << "too many venues for " << MAX_FEATURE_BOOKS << " books";
+  venues_.push_back(name);
+  books_.resize(venues_.size());
+  dirty_books_.resize(books());
+  return venues_.size() - 1;
+}
+
+void BookFeatures::add_feature_handler(FeatureHandler&& handler) {
+  handlers_.emplace_back(move(handler));
+}
+
+BatchHandler BookFeatures::batch_handler(size_t venue) {
+  CHECK (venue < venues_.size()) << "unknown venue " << venue;
+  return [this, venue](TickSpan ticks) { on_ticks(venue, ticks); };
+}
+
+void BookFeatures::on_ticks(size_t venue, TickSpan ticks) {
+  for (const Tick& tick : ticks) {
+    if (tick.type != Tick::Type::QUOTE) {
+      continue;
+    }
+    const Quote& quote = tick.as<Quote>();
+    books_[venue].apply(quote);
+    const size_t index = book(venue, quote.cyc);
+    if (!dirty_books_[index]) {
+      dirty_books_[index] = true;
+      dirty_.push_back(index);
+    }
+    features_.time[index] = quote.received;
+  }
+  if (dirty_.empty()) {
+    return;
+  }
+  for (size_t index : dirty_) {
+    refresh(index);
+  }
+  dirty_.clear();
+
+  compute(levels_, books(), features_);
+  ++features_.sequence;
+  for (auto& handler : handlers_) {
+    handler(features_);
+  }
+}
+
+void BookFeatures::refresh(size_t index) {
+  dirty_books_[index] = false;
+  const size_t venue = index / enum_size<Currency>();
+  const size_t cyc = index % enum_size<Currency>();
+  const BookSet::Side& bids = books_[venue].bids[cyc];
+  const BookSet::Side& asks = books_[venue].asks[cyc];
+  auto bid = bids.rbegin();
+  auto ask = asks.begin();
+  for (size_t level = 0; level < FEATURE_DEPTH; ++level) {
+    if (bid != bids.rend()) {
+      levels_.bid_price[level][index] = bid->first;
+      levels_.bid_volume[level][index] = bid->second;
+      ++bid;
+    } else {
+      levels_.bid_price[level][index] = 0;
+      levels_.bid_volume[level][index] = 0;
+    }
+    if (ask != asks.end()) {
+      levels_.ask_price[level][index] = ask->first;
+      levels_.ask_volume[level][index] = ask->second;
+      ++ask;
+    } else {
+      levels_.ask_price[level][index] = 0;
+      levels_.ask_volume[level][index] = 0;
+    }
+  }
+}
+
+bool BookFeatures::avx2() {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+void BookFeatures::compute(const BookLevels& levels, size_t books,
+                           FeatureVector& features) {
+  if (avx2()) {
+    compute_avx2(levels, books, features);
+  } else {
+    compute_scalar(levels, books, features);
+  }
+}
+
+// Both kernels do the same operations in the same order, so their results
+// are equal as long as the compiler does not contract the scalar code into
+// FMAs (it does not unless built for a CPU with FMA, e.g. -march=native).
+void BookFeatures::compute_scalar(const BookLevels& levels, size_t books,
+                                  FeatureVector& features) {
+  const size_t end = (books + 3) & ~size_t{3};
+  for (size_t b = 0; b < end; ++b) {
+    double bid_depth = 0;
+    double ask_depth = 0;
+    double bid_notional = 0;
+    double ask_notional = 0;
+    for (size_t level = 0; level < FEATURE_DEPTH; ++level) {
+      bid_depth += levels.bid_volume[level][b];
+      ask_depth += levels.ask_volume[level][b];
+      bid_notional += levels.bid_price[level][b] * levels.bid_volume[level][b];
+      ask_notional += levels.ask_price[level][b] * levels.ask_volume[level][b];
+    }
+    const double bid_volume = levels.bid_volume[0][b];
+    const double ask_volume = levels.ask_volume[0][b];
+    const double total = bid_depth + ask_depth;
+
+    features.microprice[b] = bid_volume > 0 && ask_volume > 0
+        ? (levels.bid_price[0][b] * ask_volume +
+           levels.ask_price[0][b] * bid_volume) / (bid_volume + ask_volume)
+        : 0;
+    features.imbalance[b] = total > 0 ? (bid_depth - ask_depth) / total : 0;
+    features.bid_depth[b] = bid_depth;
+    features.ask_depth[b] = ask_depth;
+    features.weighted_mid[b] = bid_depth > 0 && ask_depth > 0
+        ? 0.5 * (bid_notional / bid_depth + ask_notional / ask_depth)
+        : 0;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Four books per register. Divisions by zero are computed and then masked
+// to zero, which matches the scalar kernel's +0.0. Loads and stores are
+// unaligned: C++11 new does not honour alignas(32), and on aligned data
+// they cost the same.
+__attribute__((target("avx2")))
+void BookFeatures::compute_avx2(const BookLevels& levels, size_t books,
+                                FeatureVector& features) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d half = _mm256_set1_pd(0.5);
+  for (size_t b = 0; b < books; b += 4) {
+    __m256d bid_depth = zero;
+    __m256d ask_depth = zero;
+    __m256d bid_notional = zero;
+    __m256d ask_notional = zero;
+    for (size_t level = 0; level < FEATURE_DEPTH; ++level) {
+      const __m256d bid_volume = _mm256_loadu_pd(&levels.bid_volume[level][b]);
+      const __m256d ask_volume = _mm256_loadu_pd(&levels.ask_volume[level][b]);
+      bid_depth = _mm256_add_pd(bid_depth, bid_volume);
+      ask_depth = _mm256_add_pd(ask_depth, ask_volume);
+      bid_notional = _mm256_add_pd(bid_notional, _mm256_mul_pd(
+          _mm256_loadu_pd(&levels.bid_price[level][b]), bid_volume));
+      ask_notional = _mm256_add_pd(ask_notional, _mm256_mul_pd(
+          _mm256_loadu_pd(&levels.ask_price[level][b]), ask_volume));
+    }
+    const __m256d bid_volume = _mm256_loadu_pd(&levels.bid_volume[0][b]);
+    const __m256d ask_volume = _mm256_loadu_pd(&levels.ask_volume[0][b]);
+    const __m256d total = _mm256_add_pd(bid_depth, ask_depth);
+    const __m256d has_bid = _mm256_cmp_pd(bid_volume, zero, _CMP_GT_OQ);
+    const __m256d has_ask = _mm256_cmp_pd(ask_volume, zero, _CMP_GT_OQ);
+    const __m256d has_bids = _mm256_cmp_pd(bid_depth, zero, _CMP_GT_OQ);
+    const __m256d has_asks = _mm256_cmp_pd(ask_depth, zero, _CMP_GT_OQ);
+
+    const __m256d best_bid = _mm256_loadu_pd(&levels.bid_price[0][b]);
+    const __m256d best_ask = _mm256_loadu_pd(&levels.ask_price[0][b]);
+    const __m256d microprice = _mm256_div_pd(
+        _mm256_add_pd(_mm256_mul_pd(best_bid, ask_volume),
+                      _mm256_mul_pd(best_ask, bid_volume)),
+        _mm256_add_pd(bid_volume, ask_volume));
+    _mm256_storeu_pd(&features.microprice[b], _mm256_and_pd(
+        microprice, _mm256_and_pd(has_bid, has_ask)));
+
+    const __m256d imbalance =
+        _mm256_div_pd(_mm256_sub_pd(bid_depth, ask_depth), total);
+    _mm256_storeu_pd(&features.imbalance[b], _mm256_and_pd(
+        imbalance, _mm256_cmp_pd(total, zero, _CMP_GT_OQ)));
+
+    _mm256_storeu_pd(&features.bid_depth[b], bid_depth);
+    _mm256_storeu_pd(&features.ask_depth[b], ask_depth);
+
+    const __m256d weighted_mid = _mm256_mul_pd(half, _mm256_add_pd(
+        _mm256_div_pd(bid_notional, bid_depth),
+        _mm256_div_pd(ask_notional, ask_depth)));
+    _mm256_storeu_pd(&features.weighted_mid[b], _mm256_and_pd(
+        weighted_mid, _mm256_and_pd(has_bids, has_asks)));
+  }
+}
+#else
+void BookFeatures::compute_avx2(const BookLevels& levels, size_t books,
+                                FeatureVector& features) {
+  compute_scalar(levels, books, features);
+}
+#endif
+
+}  // namespace btc_arb
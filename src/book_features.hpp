@@ -0,0 +1,105 @@
+#pragma once
+
+#include "book_set.hpp"
+#include "ticker_plant.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Levels kept per side of every book.
+constexpr size_t FEATURE_DEPTH = 8;
+// Books are venue x currency; a multiple of the 4 doubles in an AVX register.
+constexpr size_t MAX_FEATURE_BOOKS = 32;
+
+// Top FEATURE_DEPTH levels of every book, structure of arrays: one row of
+// all books per level, best level first. Prices and volumes are the ticks'
+// price_int and volume_int as doubles; missing levels are zero. The kernels
+// load and store unaligned, so callers' copies need not be aligned.
+struct alignas(32) BookLevels {
+  double bid_price[FEATURE_DEPTH][MAX_FEATURE_BOOKS];
+  double bid_volume[FEATURE_DEPTH][MAX_FEATURE_BOOKS];
+  double ask_price[FEATURE_DEPTH][MAX_FEATURE_BOOKS];
+  double ask_volume[FEATURE_DEPTH][MAX_FEATURE_BOOKS];
+};
+
+// Features of every book, indexed by BookFeatures::book(). Prices are in
+// price_int units and volumes in volume_int units. A feature that needs a
+// side which is empty reads as zero.
+struct alignas(32) FeatureVector {
+  // Best bid and ask weighted by the opposite side's volume.
+  double microprice[MAX_FEATURE_BOOKS];
+  // (bid depth - ask depth) / (bid depth + ask depth), in [-1, 1].
+  double imbalance[MAX_FEATURE_BOOKS];
+  // Volume over the top FEATURE_DEPTH levels, per side.
+  double bid_depth[MAX_FEATURE_BOOKS];
+  double ask_depth[MAX_FEATURE_BOOKS];
+  // Mean of the bid and ask volume weighted average prices over the top
+  // FEATURE_DEPTH levels.
+  double weighted_mid[MAX_FEATURE_BOOKS];
+  uint64_t time[MAX_FEATURE_BOOKS];  // receive time of the last quote
+  uint64_t sequence;  // passes computed so far
+};
+
+using FeatureHandler = std::function<void(const FeatureVector&)>;
+
+// Order books of several venues and currencies, with their features
+// recomputed for all books in one pass after each batch of ticks. The pass
+// runs on AVX2 where the CPU has it and in scalar code otherwise.
+//
+// Not thread-safe: feed every venue from one thread, e.g. the handler thread
+// of a plant, and read features() or take them in a FeatureHandler on that
+// same thread. The vector is updated in place and never copied. Allocated
+// with new, it keeps its alignment through CacheAligned.
+class BookFeatures : public CacheAligned {
+ public:
+  BookFeatures();
+  BookFeatures(const BookFeatures&) = delete;
+
+  // Returns the venue id passed to on_ticks(); aborts past MAX_FEATURE_BOOKS.
+  size_t add_venue(const std::string& name);
+  void add_feature_handler(FeatureHandler&& handler);
+
+  // Applies the ticks to the venue's books, recomputes the features and
+  // calls the feature handlers.
+  void on_ticks(size_t venue, TickSpan ticks);
+  // Batch handler feeding one venue, for TickerPlant::add_batch_handler.
+  BatchHandler batch_handler(size_t venue);
+
+  static size_t book(size_t venue, Currency cyc) {
+    return venue * enum_size<Currency>() + static_cast<size_t>(cyc);
+  }
+  size_t books() const { return venues_.size() * enum_size<Currency>(); }
+  const std::vector<std::string>& venues() const { return venues_; }
+  const BookLevels& levels() const { return levels_; }
+  const FeatureVector& features() const { return features_; }
+
+  // Whether compute() runs the AVX2 kernel.
+  static bool avx2();
+  // Recomputes features from levels, for books [0, books) rounded up to a
+  // multiple of 4.
+  static void compute(const BookLevels& levels, size_t books,
+                      FeatureVector& features);
+  static void compute_scalar(const BookLevels& levels, size_t books,
+                             FeatureVector& features);
+  static void compute_avx2(const BookLevels& levels, size_t books,
+                           FeatureVector& features);
+
+ private:
+  void refresh(size_t index);
+
+  std::vector<std::string> venues_;
+  std::vector<BookSet> books_;  // per venue
+  std::vector<bool> dirty_books_;  // per book()
+  std::vector<size_t> dirty_;
+  std::vector<FeatureHandler> handlers_;
+  BookLevels levels_;
+  FeatureVector features_;
+};
+
+}  // namespace btc_arb
@@ -0,0 +1,161 @@
+#include "book_features.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+namespace btc_arb {
+namespace {
+
+// Fills books [0, books) with up to FEATURE_DEPTH levels per side, leaving
+// some sides empty or short.
+void random_levels(std::mt19937& rng, size_t books, BookLevels& levels) {
+  std::memset(&levels, 0, sizeof(levels));
+  for (size_t b = 0; b < books; ++b) {
+    const size_t bids = rng() % 5 == 0 ? 0 : 1 + rng() % FEATURE_DEPTH;
+    const size_t asks = rng() % 5 == 0 ? 0 : 1 + rng() % FEATURE_DEPTH;
+    const double mid = 1000000 + rng() % 9000000;
+    for (size_t level = 0; level < bids; ++level) {
+      levels.bid_price[level][b] = mid - 100 * (level + 1);
+      levels.bid_volume[level][b] = 1 + rng() % 100000000;
+    }
+    for (size_t level = 0; level < asks; ++level) {
+      levels.ask_price[level][b] = mid + 100 * (level + 1);
+      levels.ask_volume[level][b] = 1 + rng() % 100000000;
+    }
+  }
+}
+
+Tick quote(uint64_t received, Currency cyc, Quote::Type type,
+           int32_t price_int, int64_t volume) {
+  Quote quote{};
+  quote.received = received;
+  quote.type = type;
+  quote.total_volume_int = volume;
+  quote.cyc = cyc;
+  quote.price_int = price_int;
+  return Tick(quote);
+}
+
+// Compares the whole arrays, so books past the used ones must agree too.
+void expect_equal(const FeatureVector& a, const FeatureVector& b) {
+  for (size_t i = 0; i < MAX_FEATURE_BOOKS; ++i) {
+    EXPECT_EQ(a.microprice[i], b.microprice[i]) << "book " << i;
+    EXPECT_EQ(a.imbalance[i], b.imbalance[i]) << "book " << i;
+    EXPECT_EQ(a.bid_depth[i], b.bid_depth[i]) << "book " << i;
+    EXPECT_EQ(a.ask_depth[i], b.ask_depth[i]) << "book " << i;
+    EXPECT_EQ(a.weighted_mid[i], b.weighted_mid[i]) << "book " << i;
+  }
+}
+
+TEST(BookFeaturesTest, Avx2MatchesScalar) {
+  if (!BookFeatures::avx2()) {
+    std::cout << "no AVX2 on this CPU, skipping" << std::endl;
+    return;
+  }
+  std::mt19937 rng(7);
+  BookLevels levels;
+  FeatureVector scalar{};
+  FeatureVector avx2{};
+  for (size_t books = 1; books <= MAX_FEATURE_BOOKS; ++books) {
+    random_levels(rng, books, levels);
+    BookFeatures::compute_scalar(levels, books, scalar);
+    BookFeatures::compute_avx2(levels, books, avx2);
+    expect_equal(scalar, avx2);
+  }
+}
+
+TEST(BookFeaturesTest, ComputesFeaturesOfOneBook) {
+  BookLevels levels;
+  std::memset(&levels, 0, sizeof(levels));
+  levels.bid_price[0][0] = 100;
+  levels.bid_volume[0][0] = 3;
+  levels.bid_price[1][0] = 90;
+  levels.bid_volume[1][0] = 1;
+  levels.ask_price[0][0] = 110;
+  levels.ask_volume[0][0] = 1;
+  FeatureVector features{};
+  BookFeatures::compute(levels, 1, features);
+
+  EXPECT_DOUBLE_EQ((100 * 1 + 110 * 3) / 4.0, features.microprice[0]);
+  EXPECT_DOUBLE_EQ((4 - 1) / 5.0, features.imbalance[0]);
+  EXPECT_DOUBLE_EQ(4, features.bid_depth[0]);
+  EXPECT_DOUBLE_EQ(1, features.ask_depth[0]);
+  EXPECT_DOUBLE_EQ(0.5 * (390 / 4.0 + 110), features.weighted_mid[0]);
+  // Empty books read as zero.
+  EXPECT_EQ(0, features.microprice[1]);
+  EXPECT_EQ(0, features.imbalance[1]);
+  EXPECT_EQ(0, features.weighted_mid[1]);
+}
+
+TEST(BookFeaturesTest, TicksUpdateLevelsOfTheirBook) {
+  std::unique_ptr<BookFeatures> features{new BookFeatures};
+  features->add_venue("a");
+  features->add_venue("b");
+  uint64_t passes = 0;
+  features->add_feature_handler([&passes](const FeatureVector&) { ++passes; });
+
+  std::mt19937 rng(11);
+  BookSet reference[2];
+  std::vector<Tick> ticks;
+  for (int batch = 0; batch < 200; ++batch) {
+    const size_t venue = rng() % 2;
+    ticks.clear();
+    for (int i = 0, n = 1 + rng() % 20; i < n; ++i) {
+      const Currency cyc = static_cast<Currency>(rng() % 2);
+      const bool bid = rng() % 2;
+      ticks.push_back(quote(
+          batch, cyc, bid ? Quote::Type::BID_UPDATE : Quote::Type::ASK_UPDATE,
+          bid ? 1000 - rng() % 20 : 1001 + rng() % 20,
+          rng() % 4 == 0 ? 0 : 1 + rng() % 1000));
+      reference[venue].apply(ticks.back().as<Quote>());
+    }
+    features->on_ticks(venue, TickSpan{ticks.data(), ticks.size()});
+  }
+  EXPECT_EQ(200u, passes);
+  EXPECT_EQ(200u, features->features().sequence);
+
+  const BookLevels& levels = features->levels();
+  for (size_t venue = 0; venue < 2; ++venue) {
+    for (size_t cyc = 0; cyc < 2; ++cyc) {
+      const size_t b = BookFeatures::book(venue, static_cast<Currency>(cyc));
+      auto bid = reference[venue].bids[cyc].rbegin();
+      auto ask = reference[venue].asks[cyc].begin();
+      for (size_t level = 0; level < FEATURE_DEPTH; ++level) {
+        if (bid != reference[venue].bids[cyc].rend()) {
+          EXPECT_EQ(bid->first, levels.bid_price[level][b]);
+          EXPECT_EQ(bid->second, levels.bid_volume[level][b]);
+          ++bid;
+        } else {
+          EXPECT_EQ(0, levels.bid_volume[level][b]);
+        }
+        if (ask != reference[venue].asks[cyc].end()) {
+          EXPECT_EQ(ask->first, levels.ask_price[level][b]);
+          EXPECT_EQ(ask->second, levels.ask_volume[level][b]);
+          ++ask;
+        } else {
+          EXPECT_EQ(0, levels.ask_volume[level][b]);
+        }
+      }
+    }
+  }
+  FeatureVector expected{};
+  BookFeatures::compute_scalar(levels, features->books(), expected);
+  expect_equal(expected, features->features());
+}
+
+TEST(BookFeaturesTest, HeapInstanceIsAligned) {
+  for (int i = 0; i < 16; ++i) {
+    std::unique_ptr<BookFeatures> features{new BookFeatures};
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&features->levels()) % 32);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&features->features()) % 32);
+  }
+}
+
+}  // anonymous namespace
+}  // namespace btc_arb
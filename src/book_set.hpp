@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ticker_plant.hpp"
+
+#include <cstdint>
+#include <map>
+
+
+namespace btc_arb {
+
+// Per-currency order books rebuilt from depth updates, which carry the
+// total volume left at their price level.
+struct BookSet {
+  using Side = std::map<int32_t, int64_t>;
+
+  inline void apply(const Quote& quote);
+
+  Side bids[enum_size<Currency>()];
+  Side asks[enum_size<Currency>()];
+};
+
+void BookSet::apply(const Quote& quote) {
+  Side& side = quote.type == Quote::Type::BID_UPDATE
+      ? bids[static_cast<size_t>(quote.cyc)] : asks[static_cast<size_t>(quote.cyc)];
+  if (quote.total_volume_int > 0) {
+    side[quote.price_int] = quote.total_volume_int;
+  } else {
+    side.erase(quote.price_int);
+  }
+}
+
+}  // namespace btc_arb
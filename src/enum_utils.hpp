@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -68,4 +69,51 @@ EnumConstRefHolder<T>  enum_to_str(T const& e) {return EnumConstRefHolder<T>(e);
 template<typename T>
 EnumRefHolder<T>       enum_from_str(T& e)     {return EnumRefHolder<T>(e);}
 
+// Allocation-free lookups, usable in constant expressions. Names are
+// matched case-insensitively against the (lower-case) EnumStrings table.
+constexpr char ascii_tolower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Compares the first len chars of str with the null-terminated name.
+constexpr bool name_equals(const char* str, size_t len, const char* name) {
+  return len == 0 ? *name == '\0'
+      : (*name != '\0' && ascii_tolower(*str) == *name &&
+         name_equals(str + 1, len - 1, name + 1));
+}
+
+template<size_t N>
+constexpr int name_index(const char* const (&names)[N],
+                         const char* str, size_t len, size_t i = 0) {
+  return i == N ? -1
+      : name_equals(str, len, names[i]) ? static_cast<int>(i)
+      : name_index(names, str, len, i + 1);
+}
+
+template<typename T>
+constexpr size_t enum_size() {
+  return sizeof(EnumStrings<T>::names) / sizeof(EnumStrings<T>::names[0]);
+}
+
+template<typename T>
+constexpr int enum_index(const char* str, size_t len) {
+  return name_index(EnumStrings<T>::names, str, len);
+}
+
+template<typename T>
+constexpr const char* enum_name(T value) {
+  return EnumStrings<T>::names[static_cast<size_t>(value)];
+}
+
+// Returns false, leaving value untouched, if str names no enumerator.
+template<typename T>
+inline bool enum_from_chars(const char* str, size_t len, T& value) {
+  const int index = enum_index<T>(str, len);
+  if (index < 0) {
+    return false;
+  }
+  value = static_cast<T>(index);
+  return true;
+}
+
 }  // namespace btc_arb
@@ -0,0 +1,102 @@
+#include "event_log.hpp"
+
+#include <glog/logging.h>
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace btc_arb;
+
+namespace {
+struct DecodedSite {
+  EventLevel level;
+  int32_t line;
+  string file;
+  string format;
+};
+
+template<typename T>
+bool read_pod(istream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool read_str(istream& in, string& str) {
+  uint16_t len;
+  if (!read_pod(in, len)) {
+    return false;
+  }
+  str.resize(len);
+  return static_cast<bool>(in.read(&str[0], len));
+}
+
+void print_event(const DecodedSite& site, const EventRecord& record) {
+  const time_t seconds = record.timestamp / 1000000000;
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+  cout << static_cast<char>(toupper(enum_name(site.level)[0])) << " "
+       << put_time(&tm, "%Y-%m-%d %H:%M:%S") << "."
+       << setfill('0') << setw(9) << record.timestamp % 1000000000
+       << setfill(' ') << " " << site.file << ":" << site.line << "] "
+       << format_event(site.format.c_str(), record) << "\n";
+}
+}  // anonymous namespace
+
+// Turns a binary event log written by EventLog back into text.
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " <EVENT_LOG>" << endl;
+    return 1;
+  }
+  ifstream in(argv[1], ios::in | ios::binary);
+  if (!in.is_open()) {
+    LOG(ERROR) << "could not open " << argv[1];
+    return 1;
+  }
+  string magic(sizeof(EVENT_LOG_MAGIC) - 1, '\0');
+  if (!in.read(&magic[0], magic.size()) || magic != EVENT_LOG_MAGIC) {
+    LOG(ERROR) << argv[1] << " is not an event log";
+    return 1;
+  }
+
+  vector<DecodedSite> sites;
+  EventFrame frame;
+  while (read_pod(in, frame)) {
+    if (frame == EventFrame::SITE) {
+      uint32_t id;
+      uint8_t level;
+      DecodedSite site;
+      if (!read_pod(in, id) || !read_pod(in, level) || !read_pod(in, site.line) ||
+          !read_str(in, site.file) || !read_str(in, site.format)) {
+        break;
+      }
+      site.level = static_cast<EventLevel>(level);
+      if (id >= sites.size()) {
+        sites.resize(id + 1);
+      }
+      sites[id] = move(site);
+    } else if (frame == EventFrame::EVENT) {
+      EventRecord record;
+      if (!read_pod(in, record)) {
+        break;
+      }
+      CHECK (record.site < sites.size()) << "event for unknown site " << record.site;
+      print_event(sites[record.site], record);
+    } else {
+      LOG(ERROR) << "corrupt frame " << static_cast<int>(frame);
+      return 2;
+    }
+  }
+  if (!in.eof()) {
+    LOG(WARNING) << "truncated event log";
+  }
+  return 0;
+}
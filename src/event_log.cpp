@@ -0,0 +1,208 @@
+#include "event_log.hpp"
+#include "spsc_ring.hpp"
+
+#include <glog/logging.h>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+constexpr const char* EnumStrings<EventLevel>::names[];
+
+namespace {
+constexpr size_t EVENT_RING_SIZE = 4096;
+constexpr auto IDLE_SLEEP = chrono::milliseconds(1);
+constexpr auto OVERFLOW_REPORT_FREQ = chrono::seconds(10);
+
+struct EventLogState {
+  mutex lock;
+  vector<EventSite*> sites;
+  vector<unique_ptr<SpscRing<EventRecord>>> rings;
+  vector<bool> sites_written;
+  atomic<uint64_t> overflows{0};
+  atomic<bool> running{false};
+  thread writer;
+  ofstream out;
+};
+
+EventLogState& state() {
+  static EventLogState state;
+  return state;
+}
+
+thread_local SpscRing<EventRecord>* local_ring = nullptr;
+
+template<typename T>
+void write_pod(ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void write_str(ofstream& out, const char* str) {
+  const uint16_t len = strlen(str);
+  write_pod(out, len);
+  out.write(str, len);
+}
+
+// Called with state().lock held.
+void emit(EventLogState& s, const EventRecord& record) {
+  const EventSite& site = *s.sites[record.site];
+  if (!s.out.is_open()) {
+    google::LogMessage(site.file, site.line,
+                       static_cast<google::LogSeverity>(site.level)).stream()
+        << format_event(site.format, record);
+    return;
+  }
+  if (!s.sites_written[record.site]) {
+    write_pod(s.out, EventFrame::SITE);
+    write_pod(s.out, site.id);
+    write_pod(s.out, static_cast<uint8_t>(site.level));
+    write_pod(s.out, static_cast<int32_t>(site.line));
+    write_str(s.out, site.file);
+    write_str(s.out, site.format);
+    s.sites_written[record.site] = true;
+  }
+  write_pod(s.out, EventFrame::EVENT);
+  write_pod(s.out, record);
+}
+
+size_t drain(EventLogState& s) {
+  lock_guard<mutex> guard(s.lock);
+  size_t drained = 0;
+  for (auto& ring : s.rings) {
+    while (const EventRecord* record = ring->front()) {
+      emit(s, *record);
+      ring->pop();
+      ++drained;
+    }
+  }
+  return drained;
+}
+
+void writer_loop() {
+  EventLogState& s = state();
+  auto last_report = chrono::steady_clock::now();
+  while (s.running.load(memory_order_acquire)) {
+    if (drain(s) == 0) {
+      this_thread::sleep_for(IDLE_SLEEP);
+    }
+    const auto now = chrono::steady_clock::now();
+    if (now - last_report >= OVERFLOW_REPORT_FREQ) {
+      const uint64_t overflows = s.overflows.exchange(0);
+      if (overflows > 0) {
+        LOG(WARNING) << overflows << " events dropped, event rings full";
+      }
+      last_report = now;
+    }
+  }
+  drain(s);
+}
+}  // anonymous namespace
+
+atomic<bool> EventLog::enabled_{false};
+
+EventSite::EventSite(EventLevel level_, const char* format_, const char* file_,
+                     int line_, uint32_t max_per_sec_)
+    : level(level_), format(format_), file(file_), line(line_),
+      max_per_sec(max_per_sec_),
+      id([this]() {
+          EventLogState& s = state();
+          lock_guard<mutex> guard(s.lock);
+          s.sites.push_back(this);
+          s.sites_written.push_back(false);
+          return static_cast<uint32_t>(s.sites.size() - 1);
+        }()) {}
+
+void EventLog::start(const string& path) {
+  EventLogState& s = state();
+  CHECK (!s.running) << "event log already started";
+  if (!path.empty()) {
+    s.out.open(path, ios::out | ios::binary | ios::trunc);
+    CHECK (s.out.is_open()) << "could not open event log " << path;
+    s.out.write(EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC) - 1);
+    fill(s.sites_written.begin(), s.sites_written.end(), false);
+  }
+  s.running = true;
+  s.writer = thread(writer_loop);
+  enabled_ = true;
+}
+
+void EventLog::stop() {
+  EventLogState& s = state();
+  if (!s.running) {
+    return;
+  }
+  enabled_ = false;
+  s.running.store(false, memory_order_release);
+  s.writer.join();
+  // Records committed by threads that passed enabled() just before it was
+  // cleared can land after the writer's last drain.
+  drain(s);
+  if (s.out.is_open()) {
+    s.out.close();
+  }
+}
+
+EventRecord* EventLog::next_record() {
+  if (local_ring == nullptr) {
+    EventLogState& s = state();
+    lock_guard<mutex> guard(s.lock);
+    s.rings.emplace_back(new SpscRing<EventRecord>(EVENT_RING_SIZE));
+    local_ring = s.rings.back().get();
+  }
+  EventRecord* record = local_ring->next_slot();
+  if (record == nullptr) {
+    state().overflows.fetch_add(1, memory_order_relaxed);
+  }
+  return record;
+}
+
+void EventLog::commit_record() {
+  local_ring->commit();
+}
+
+string format_event(const char* format, const EventRecord& record) {
+  ostringstream out;
+  size_t arg = 0;
+  for (const char* c = format; *c != '\0'; ++c) {
+    if (c[0] != '{' || c[1] != '}' || arg >= record.num_args) {
+      out << *c;
+      continue;
+    }
+    const uint64_t value = record.args[arg];
+    switch (record.types[arg]) {
+      case EventArgType::I64:
+        out << static_cast<int64_t>(value);
+        break;
+      case EventArgType::U64:
+        out << value;
+        break;
+      case EventArgType::F64: {
+        double d;
+        memcpy(&d, &value, sizeof(d));
+        out << d;
+        break;
+      }
+      case EventArgType::STR:
+        out << (value < EVENT_TEXT_SIZE ? record.text + value : "");
+        break;
+      case EventArgType::NONE:
+        break;
+    }
+    ++arg;
+    ++c;
+  }
+  if (record.suppressed > 0) {
+    out << " [" << record.suppressed << " suppressed]";
+  }
+  return out.str();
+}
+
+}  // namespace btc_arb
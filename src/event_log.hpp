@@ -0,0 +1,230 @@
+#pragma once
+
+#include "enum_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+
+namespace btc_arb {
+
+// Structured event logging for the hot path. A call such as
+//
+//   EVENT_LOG(INFO, "Q {} lag={} {} @ {}", quote.received, lag, volume, price);
+//
+// only copies its arguments into a per-thread ring; a background thread
+// either formats them to glog or appends them to a binary file that
+// event_decode turns back into text. Every call site is rate-limited
+// (EVENT_LOG_RATE overrides the default) and reports how many events it
+// suppressed. Events logged before EventLog::start() or after
+// EventLog::stop() are discarded; stop() writes out everything logged
+// before it.
+
+enum class EventLevel { INFO, WARNING, ERROR };
+
+template<> struct EnumStrings<EventLevel> {
+  static constexpr const char* names[] = {"info", "warning", "error"};
+};
+
+enum class EventArgType : uint8_t { NONE, I64, U64, F64, STR };
+
+constexpr size_t MAX_EVENT_ARGS = 5;
+constexpr size_t EVENT_TEXT_SIZE = 64;
+constexpr uint32_t DEFAULT_EVENT_RATE = 100;  // events per second per site
+
+// Binary log layout: EVENT_LOG_MAGIC followed by frames, each starting
+// with an EventFrame byte. A SITE frame (u32 id, u8 level, i32 line,
+// u16 + file, u16 + format) precedes the first EVENT frame (a raw
+// EventRecord) that refers to it.
+constexpr char EVENT_LOG_MAGIC[] = "BTCEVT01";
+enum class EventFrame : uint8_t { SITE = 1, EVENT = 2 };
+
+// Fixed-size record as it sits in the ring and in the binary log. Strings
+// are copied, null-terminated, into text; their argument holds the offset.
+struct EventRecord {
+  uint64_t timestamp;  // ns since epoch
+  uint32_t site;
+  uint32_t suppressed;  // events dropped by this site's rate limit since the last one
+  uint8_t num_args;
+  EventArgType types[MAX_EVENT_ARGS];
+  uint8_t text_used;
+  uint64_t args[MAX_EVENT_ARGS];
+  char text[EVENT_TEXT_SIZE];
+};
+
+class EventSite {
+ public:
+  EventSite(EventLevel level, const char* format, const char* file, int line,
+            uint32_t max_per_sec = DEFAULT_EVENT_RATE);
+
+  EventSite(const EventSite&) = delete;
+
+  // Applies the per-second rate limit; on success sets suppressed to the
+  // number of events rejected since the previous admitted one.
+  inline bool admit(uint64_t now, uint32_t& suppressed);
+
+  const EventLevel level;
+  const char* const format;
+  const char* const file;
+  const int line;
+  const uint32_t max_per_sec;
+  const uint32_t id;
+
+ private:
+  std::atomic<uint64_t> window_{0};
+  std::atomic<uint32_t> in_window_{0};
+  std::atomic<uint32_t> suppressed_{0};
+};
+
+bool EventSite::admit(uint64_t now, uint32_t& suppressed) {
+  if (max_per_sec != 0) {
+    const uint64_t window = now / 1000000000;
+    if (window_.load(std::memory_order_relaxed) != window) {
+      window_.store(window, std::memory_order_relaxed);
+      in_window_.store(0, std::memory_order_relaxed);
+    }
+    if (in_window_.fetch_add(1, std::memory_order_relaxed) >= max_per_sec) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+class EventLog {
+ public:
+  // With an empty path events are formatted to glog, otherwise they are
+  // written in binary to path.
+  static void start(const std::string& path = "");
+  // Drains every thread's ring and joins the background thread.
+  static void stop();
+  static bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Claims a slot in the calling thread's ring, or nullptr if it is full.
+  static EventRecord* next_record();
+  static void commit_record();
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+class ScopedEventLog {
+ public:
+  explicit ScopedEventLog(const std::string& path = "") { EventLog::start(path); }
+  ~ScopedEventLog() { EventLog::stop(); }
+  ScopedEventLog(const ScopedEventLog&) = delete;
+};
+
+// Substitutes each "{}" in format with the record's next argument.
+std::string format_event(const char* format, const EventRecord& record);
+
+namespace event_detail {
+
+template<typename T>
+inline typename std::enable_if<
+  std::is_integral<T>::value && std::is_signed<T>::value>::type
+encode(EventRecord& record, size_t i, T value) {
+  record.types[i] = EventArgType::I64;
+  record.args[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+}
+
+template<typename T>
+inline typename std::enable_if<
+  std::is_integral<T>::value && !std::is_signed<T>::value>::type
+encode(EventRecord& record, size_t i, T value) {
+  record.types[i] = EventArgType::U64;
+  record.args[i] = static_cast<uint64_t>(value);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type
+encode(EventRecord& record, size_t i, T value) {
+  record.types[i] = EventArgType::I64;
+  record.args[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+encode(EventRecord& record, size_t i, T value) {
+  const double d = value;
+  record.types[i] = EventArgType::F64;
+  std::memcpy(&record.args[i], &d, sizeof(d));
+}
+
+inline void encode_str(EventRecord& record, size_t i,
+                       const char* str, size_t len) {
+  const size_t room = EVENT_TEXT_SIZE - record.text_used - 1;
+  if (len > room) {
+    len = room;
+  }
+  std::memcpy(record.text + record.text_used, str, len);
+  record.text[record.text_used + len] = '\0';
+  record.types[i] = EventArgType::STR;
+  record.args[i] = record.text_used;
+  record.text_used = std::min(record.text_used + len + 1, EVENT_TEXT_SIZE - 1);
+}
+
+inline void encode(EventRecord& record, size_t i, const char* value) {
+  encode_str(record, i, value, std::strlen(value));
+}
+
+inline void encode(EventRecord& record, size_t i, const std::string& value) {
+  encode_str(record, i, value.data(), value.size());
+}
+
+inline void encode_all(EventRecord&, size_t) {}
+
+template<typename T, typename... Args>
+inline void encode_all(EventRecord& record, size_t i,
+                       const T& value, const Args&... args) {
+  encode(record, i, value);
+  encode_all(record, i + 1, args...);
+}
+
+template<typename... Args>
+inline void log_event(EventSite& site, const Args&... args) {
+  static_assert(sizeof...(Args) <= MAX_EVENT_ARGS, "too many event arguments");
+  const uint64_t now =
+      std::chrono::system_clock::now().time_since_epoch().count();
+  uint32_t suppressed;
+  if (!site.admit(now, suppressed)) {
+    return;
+  }
+  EventRecord* record = EventLog::next_record();
+  if (record == nullptr) {
+    return;
+  }
+  // Records are written out as raw structs; clear padding and stale
+  // argument bytes left over from the slot's previous lap.
+  std::memset(record, 0, sizeof(EventRecord));
+  record->timestamp = now;
+  record->site = site.id;
+  record->suppressed = suppressed;
+  record->num_args = sizeof...(Args);
+  encode_all(*record, 0, args...);
+  EventLog::commit_record();
+}
+
+}  // namespace event_detail
+
+#define EVENT_LOG_RATE(level, max_per_sec, format, ...)                 \
+  do {                                                                  \
+    if (::btc_arb::EventLog::enabled()) {                               \
+      static ::btc_arb::EventSite event_site_{                          \
+        ::btc_arb::EventLevel::level, format, __FILE__, __LINE__,       \
+        max_per_sec};                                                   \
+      ::btc_arb::event_detail::log_event(event_site_, ##__VA_ARGS__);   \
+    }                                                                   \
+  } while (false)
+
+#define EVENT_LOG(level, format, ...)                                   \
+  EVENT_LOG_RATE(level, ::btc_arb::DEFAULT_EVENT_RATE, format, ##__VA_ARGS__)
+
+}  // namespace btc_arb
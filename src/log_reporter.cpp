@@ -18,18 +18,17 @@ constexpr uint32_t REPORT_COUNT = 10000;
 
 class TickCounter {
  public:
-  void operator() (const Tick& tick) {
-    ++count_;
-    if (tick.type == Tick::Type::TRADE) {
-      ++trades_;
-    } else if (tick.type == Tick::Type::QUOTE) {
-      ++quotes_;
+  void operator() (TickSpan ticks) {
+    count_ += ticks.size;
+    for (const Tick& tick : ticks) {
+      trades_ += tick.type == Tick::Type::TRADE;
+      quotes_ += tick.type == Tick::Type::QUOTE;
     }
   }
 
-  int get_count() const { return count_; }
-  int get_trades() const { return trades_; }
-  int get_quotes() const { return quotes_; }
+  uint64_t get_count() const { return count_; }
+  uint64_t get_trades() const { return trades_; }
+  uint64_t get_quotes() const { return quotes_; }
 
   void reset() {
     count_ = 0;
@@ -38,16 +37,16 @@ class TickCounter {
   }
 
  private:
-  int count_ = 0;
-  int trades_ = 0;
-  int quotes_ = 0;
+  uint64_t count_ = 0;
+  uint64_t trades_ = 0;
+  uint64_t quotes_ = 0;
 };
 
-void report_progress_time(const Tick& tick) {
-  static TickCounter counter;
-  static auto last = std::chrono::system_clock::now();
+void report_progress_time(TickSpan ticks) {
+  thread_local TickCounter counter;
+  thread_local auto last = std::chrono::system_clock::now();
 
-  counter(tick);
+  counter(ticks);
   auto now = std::chrono::system_clock::now();
   chrono::duration<double> elapsed_seconds = now - last;
   if (elapsed_seconds.count() >= REPORT_FREQ) {
@@ -60,11 +59,11 @@ void report_progress_time(const Tick& tick) {
   }
 }
 
-void report_progress_block(const Tick& tick) {
-  static TickCounter counter;
-  static auto last = std::chrono::system_clock::now();
-  counter(tick);
-  if (counter.get_count() % REPORT_COUNT == 0) {
+void report_progress_block(TickSpan ticks) {
+  thread_local TickCounter counter;
+  thread_local auto last = std::chrono::system_clock::now();
+  counter(ticks);
+  if (counter.get_count() >= REPORT_COUNT) {
     auto now = std::chrono::system_clock::now();
     chrono::duration<double> elapsed_seconds = now - last;
     LOG(INFO) << "[" << setprecision(4)
@@ -6,7 +6,8 @@
 
 namespace btc_arb {
 
-void report_progress_time(const Tick& tick);
-void report_progress_block(const Tick& tick);
+// Batch handlers; add with TickerPlant::add_batch_handler.
+void report_progress_time(TickSpan ticks);
+void report_progress_block(TickSpan ticks);
 
 }  // namespace btc_arb
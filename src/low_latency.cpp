@@ -0,0 +1,76 @@
+#include "low_latency.hpp"
+
+#include <glog/logging.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <cmath>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+void pin_current_thread(int cpu) {
+  if (cpu < 0) {
+    return;
+  }
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+  if (err != 0) {
+    LOG(WARNING) << "could not pin thread to cpu " << cpu << " (errno=" << err << ")";
+  } else {
+    LOG(INFO) << "thread pinned to cpu " << cpu;
+  }
+}
+
+void lock_process_memory() {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    PLOG(WARNING) << "mlockall failed, memory may be paged out";
+  }
+}
+
+void set_socket_busy_poll(int fd, int usec) {
+#ifdef SO_BUSY_POLL
+  if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0) {
+    PLOG(WARNING) << "could not set SO_BUSY_POLL=" << usec;
+  }
+#else
+  LOG(WARNING) << "SO_BUSY_POLL not supported on this platform";
+#endif
+}
+
+uint64_t LatencyHistogram::percentile(double pct) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const uint64_t rank = static_cast<uint64_t>(ceil(count_ * pct / 100.0));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return i == 0 ? 0 : min(max_, (uint64_t{1} << i) - 1);
+    }
+  }
+  return max_;
+}
+
+void LatencyHistogram::report(const string& name) const {
+  LOG(INFO) << name << " n=" << count_
+            << " p50<=" << percentile(50) << " p90<=" << percentile(90)
+            << " p99<=" << percentile(99) << " p99.9<=" << percentile(99.9)
+            << " max=" << max_;
+}
+
+void LatencyHistogram::reset() {
+  buckets_.fill(0);
+  count_ = 0;
+  max_ = 0;
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace btc_arb {
+
+// Settings for the live feed's low-latency run mode. With busy_poll unset
+// the plant keeps the default blocking run loop and the fields that only
+// apply to the pipeline (CPUs, rings) are ignored; lock_memory and
+// so_busy_poll_usec apply in both modes.
+struct LowLatencyConfig {
+  bool busy_poll = false;     // spin on poll() instead of blocking in run()
+  int network_cpu = -1;       // -1 leaves the thread unpinned
+  int parse_cpu = -1;
+  int handler_cpu = -1;
+  int so_busy_poll_usec = 0;  // SO_BUSY_POLL on the feed socket, 0 = off
+  bool lock_memory = false;   // mlockall(), and pre-fault the rings if any
+  size_t ring_size = 1024;    // slots per stage, power of two
+};
+
+void pin_current_thread(int cpu);
+void lock_process_memory();
+void set_socket_busy_poll(int fd, int usec);
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Power-of-two bucketed histogram, cheap enough to record on every tick.
+// Bucket i holds values in [2^(i-1), 2^i).
+class LatencyHistogram {
+ public:
+  static constexpr size_t NUM_BUCKETS = 64;
+
+  inline void record(uint64_t value) {
+    ++buckets_[value == 0 ? 0 : 64 - __builtin_clzll(value)];
+    ++count_;
+    if (value > max_) {
+      max_ = value;
+    }
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  // Upper bound of the bucket holding the given percentile (0-100).
+  uint64_t percentile(double pct) const;
+  void report(const std::string& name) const;
+  void reset();
+
+ private:
+  std::array<uint64_t, NUM_BUCKETS> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+}  // namespace btc_arb
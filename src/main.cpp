@@ -1,11 +1,17 @@
 #include "ticker_plant.hpp"
+#include "book_features.hpp"
 #include "log_reporter.hpp"
+#include "low_latency.hpp"
+#include "metrics.hpp"
+#include "zmq_transport.hpp"
 #include "mtgox.hpp"
 #include "enum_utils.hpp"
+#include "event_log.hpp"
 
 #include <boost/program_options.hpp>
 #include <glog/logging.h>
 
+#include <csignal>
 #include <iostream>
 #include <iomanip>
 #include <memory>
@@ -21,16 +27,17 @@ using namespace std;
 using namespace btc_arb;
 
 namespace btc_arb {
-enum class SourceType { FLAT, FLAT_MTGOX, WS_MTGOX };
-enum class SinkType { FLAT, FLAT_RAW };
+enum class SourceType { FLAT, FLAT_MTGOX, WS_MTGOX, ZMQ, RAW_MTGOX };
+enum class SinkType { FLAT, FLAT_RAW, ZMQ, RAW };
 
 template<> struct EnumStrings<SourceType> {
-    static constexpr const char* names[] = {"flat", "flat_mtgox", "ws_mtgox"};
+    static constexpr const char* names[] = {
+      "flat", "flat_mtgox", "ws_mtgox", "zmq", "raw_mtgox"};
 };
 constexpr const char* EnumStrings<SourceType>::names[];
 
 template<> struct EnumStrings<SinkType> {
-    static constexpr const char* names[] = {"flat", "flat_raw"};
+    static constexpr const char* names[] = {"flat", "flat_raw", "zmq", "raw"};
 };
 constexpr const char* EnumStrings<SinkType>::names[];
 }
@@ -64,6 +71,12 @@ vector<PrependedPath<T>> PrependedPath<T>::parse_all(const vector<string>& s) {
   transform(s.begin(), s.end(), parsed.begin(), PrependedPath<T>::parse);
   return parsed;
 }
+
+ZmqTickerPlant* zmq_plant = nullptr;
+
+void stop_zmq_plant(int) {
+  zmq_plant->stop();
+}
 }  // anonymous namespace
 
 int main(int argc, char **argv) {
@@ -73,6 +86,13 @@ int main(int argc, char **argv) {
   google::LogToStderr();
 
   string source_str{"ws_mtgox:ws://websocket.mtgox.com/mtgox"};
+  string event_log_path;
+  uint16_t metrics_port{0};
+  string venue;
+  string progress;
+  bool book_features{false};
+  ZmqPublisherConfig zmq_config;
+  LowLatencyConfig low_latency;
 
   stringstream desc_msg;
   desc_msg << "Ticker Plant -- persists market data and runs strategies "
@@ -87,11 +107,58 @@ int main(int argc, char **argv) {
       ("source",
        po::value<string>(&source_str)->value_name("TYPE:PATH"),
        ("the market data souce; can also be specified as a positional arg; "
-        "available types: flat, flat_mtgox, ws_mtgox; "
+        "available types: flat, flat_mtgox, ws_mtgox, zmq, raw_mtgox "
+        "(raw capture, PATH[#START_NS]); "
         "default=" + source_str).c_str())
       ("sink",
        po::value<vector<string>>()->value_name("TYPE:PATH"),
-       "specifies a sink for the ticks; available types: flat, flat_raw");
+       "specifies a sink for the ticks; available types: flat, flat_raw, zmq, "
+       "raw (framed capture of the received messages)")
+      ("venue",
+       po::value<string>(&venue)->value_name("NAME"),
+       "venue used in zmq topics; defaults to the source's venue, which a zmq "
+       "source takes from its first message")
+      ("zmq-batch-us",
+       po::value<uint64_t>(&zmq_config.max_batch_delay_us)->value_name("USEC"),
+       "longest a tick waits in a zmq batch; 0 disables batching")
+      ("zmq-batch-ticks",
+       po::value<size_t>(&zmq_config.max_batch_ticks)->value_name("N"),
+       "most ticks per zmq message")
+      ("event-log",
+       po::value<string>(&event_log_path)->value_name("PATH"),
+       "writes hot-path events in binary to PATH (read with event_decode) "
+       "instead of formatting them to the log")
+      ("progress",
+       po::value<string>(&progress)->value_name("MODE"),
+       "logs trade and quote counts every second (time) or every 10000 "
+       "ticks (block)")
+      ("book-features",
+       po::bool_switch(&book_features),
+       "computes microprice, imbalance and depth features of the source's "
+       "books after every batch and logs those that changed")
+      ("metrics-port",
+       po::value<uint16_t>(&metrics_port)->value_name("PORT"),
+       "serves Prometheus metrics on http://127.0.0.1:PORT; 0 disables")
+      ("busy-poll",
+       po::bool_switch(&low_latency.busy_poll),
+       "live feeds only; run network, parse and handler stages on separate "
+       "spinning threads instead of the blocking event loop")
+      ("network-cpu",
+       po::value<int>(&low_latency.network_cpu)->value_name("CPU"),
+       "with --busy-poll, pins the network thread to CPU")
+      ("parse-cpu",
+       po::value<int>(&low_latency.parse_cpu)->value_name("CPU"),
+       "with --busy-poll, pins the parse thread to CPU")
+      ("handler-cpu",
+       po::value<int>(&low_latency.handler_cpu)->value_name("CPU"),
+       "with --busy-poll, pins the handler thread to CPU")
+      ("so-busy-poll",
+       po::value<int>(&low_latency.so_busy_poll_usec)->value_name("USEC"),
+       "sets SO_BUSY_POLL on the feed socket")
+      ("lock-memory",
+       po::bool_switch(&low_latency.lock_memory),
+       "live feeds only; mlockall() the process and, with --busy-poll, "
+       "pre-fault the rings");
   po::positional_options_description positional;
   positional.add("source", -1);
 
@@ -105,7 +172,19 @@ int main(int argc, char **argv) {
       return 0;
     }
 
+    ScopedEventLog event_log{event_log_path};
+    unique_ptr<MetricsServer> metrics_server;
+    if (metrics_port != 0) {
+      metrics_server.reset(new MetricsServer(metrics_port));
+    }
     PrependedPath<SourceType> spath = PrependedPath<SourceType>::parse(source_str);
+    if (spath.type != SourceType::WS_MTGOX &&
+        (low_latency.busy_poll || low_latency.lock_memory)) {
+      throw runtime_error("--busy-poll and --lock-memory need a live source");
+    }
+    if (!progress.empty() && progress != "time" && progress != "block") {
+      throw runtime_error("unknown --progress mode '" + progress + "'");
+    }
     unique_ptr<TickerPlant> plant{nullptr};
     switch (spath.type) {
       case SourceType::FLAT:
@@ -115,31 +194,70 @@ int main(int argc, char **argv) {
         plant.reset(new FileTickerPlant<mtgox::FeedParser>(spath.path));
         break;
       case SourceType::WS_MTGOX:
-        plant.reset(new WebSocketTickerPlant<mtgox::FeedParser>(spath.path));
+        plant.reset(new WebSocketTickerPlant<mtgox::FeedParser>(
+            spath.path, low_latency));
+        break;
+      case SourceType::ZMQ:
+        zmq_plant = new ZmqTickerPlant(spath.path);
+        plant.reset(zmq_plant);
+        signal(SIGINT, stop_zmq_plant);
+        signal(SIGTERM, stop_zmq_plant);
         break;
+      case SourceType::RAW_MTGOX:
+        plant.reset(new RawCaptureTickerPlant<mtgox::FeedParser>(spath.path));
+        break;
+    }
+    // A zmq source learns its venue from upstream, once a zmq sink needs it.
+    if (venue.empty() && spath.type != SourceType::ZMQ) {
+      venue = (spath.type == SourceType::FLAT_MTGOX ||
+               spath.type == SourceType::WS_MTGOX ||
+               spath.type == SourceType::RAW_MTGOX) ? mtgox::Venue::name
+                                                    : "unknown";
     }
 
     if (variables.count("sink")) {
       auto sinks = PrependedPath<SinkType>::parse_all(
           variables["sink"].as<vector<string>>());
       for_each(sinks.begin(), sinks.end(),
-               [&plant](const PrependedPath<SinkType> &sink) {
+               [&](const PrependedPath<SinkType> &sink) {
                  using TickLog = void(FileLogger::*)(const Tick&);
                  using RawLog = void(FileLogger::*)(const string&);
-                 FileLogger logger(sink.path);
                  switch(sink.type) {
                    case SinkType::FLAT: {
                      auto handler = bind(static_cast<TickLog>(&FileLogger::log),
-                                         move(logger), ph::_1);
+                                         FileLogger(sink.path), ph::_1);
                      plant->add_tick_handler(move(handler));
                      break;
                    }
                    case SinkType::FLAT_RAW: {
                      RawHandler handler{bind(static_cast<RawLog>(&FileLogger::log),
-                                             move(logger), ph::_1)};
+                                             FileLogger(sink.path), ph::_1)};
                       plant->add_raw_handler(move(handler));
                      break;
                    }
+                   case SinkType::ZMQ: {
+                     if (venue.empty()) {
+                       // Relays keep the upstream venue in their topics.
+                       venue = zmq_plant->venue();
+                     }
+                     shared_ptr<ZmqPublisher> publisher{
+                       new ZmqPublisher(sink.path, venue, zmq_config)};
+                     plant->add_tick_handler([publisher](const Tick& tick) {
+                         publisher->publish(tick);
+                       });
+                     break;
+                   }
+                   case SinkType::RAW: {
+                     shared_ptr<RawCaptureWriter> writer{
+                       new RawCaptureWriter(sink.path)};
+                     Counter* bytes = &PlantMetrics::instance().sink_bytes;
+                     plant->add_frame_handler(
+                         [writer, bytes](const RawFrame& frame) {
+                           writer->write(frame);
+                           bytes->inc(sizeof(RawFrameHeader) + frame.size);
+                         });
+                     break;
+                   }
                  }
                  cout << "sink " << enum_to_str(sink.type) << " "
                       << sink.path << endl;
@@ -149,17 +267,49 @@ int main(int argc, char **argv) {
     plant->add_tick_handler([](const Tick& tick) {
         if (tick.type == Tick::Type::QUOTE) {
           const Quote& quote = tick.as<Quote>();
-          LOG(INFO) << "Q " << quote.received << " " << quote.ex_time << " lag="
-                    << (quote.received - quote.ex_time)
-                    << " " << quote.total_volume << " @ " << quote.price;
-
+          EVENT_LOG(INFO, "Q {} {} lag={} {} @ {}", quote.received,
+                    quote.ex_time, quote.received - quote.ex_time,
+                    quote.total_volume, quote.price);
         } else if (tick.type == Tick::Type::TRADE) {
           const Trade& trade = tick.as<Trade>();
+          EVENT_LOG(INFO, "T {} {} lag={} {} @ {}", trade.received,
+                    trade.ex_time, trade.received - trade.ex_time,
+                    trade.amount, trade.price);
         }
-        cout << static_cast<int>(tick.type) << endl;
       });
+    if (book_features) {
+      shared_ptr<BookFeatures> features{new BookFeatures};
+      features->add_venue(venue.empty() ? "zmq" : venue);
+      // Logs the books whose last quote changed since the previous pass.
+      vector<uint64_t> logged(features->books(), 0);
+      features->add_feature_handler(
+          [logged](const FeatureVector& computed) mutable {
+            for (size_t b = 0; b < logged.size(); ++b) {
+              if (computed.time[b] == logged[b]) {
+                continue;
+              }
+              logged[b] = computed.time[b];
+              EVENT_LOG(INFO, "F {} {} microprice={} imbalance={} "
+                        "weighted_mid={}", computed.time[b],
+                        enum_name(static_cast<Currency>(
+                            b % enum_size<Currency>())),
+                        computed.microprice[b], computed.imbalance[b],
+                        computed.weighted_mid[b]);
+            }
+          });
+      plant->add_batch_handler([features](TickSpan ticks) {
+          features->on_ticks(0, ticks);
+        });
+    }
+    if (progress == "time") {
+      plant->add_batch_handler(report_progress_time);
+    } else if (progress == "block") {
+      plant->add_batch_handler(report_progress_block);
+    }
     LOG (INFO) << "starting ticker plant";
-    plant->run();
+    if (!plant->run()) {
+      return 3;
+    }
   } catch (const boost::program_options::unknown_option& e) {
     LOG(ERROR) << e.what();
     return 1;
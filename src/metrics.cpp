@@ -0,0 +1,234 @@
+#include "metrics.hpp"
+
+#include <glog/logging.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <new>
+#include <sstream>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+atomic<size_t> next_metric_shard{0};
+constexpr size_t Histogram::NUM_BUCKETS;
+
+namespace {
+constexpr int ACCEPT_POLL_MS = 200;
+constexpr size_t MAX_REQUEST_SIZE = 4096;
+
+// Indexed by MetricsRegistry::Kind.
+const char* KIND_NAMES[] = {"counter", "gauge", "histogram"};
+
+string with_labels(const string& name, const string& labels,
+                   const string& extra = "") {
+  if (labels.empty() && extra.empty()) {
+    return name;
+  }
+  return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",")
+      + extra + "}";
+}
+
+void send_all(int fd, const string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    sent += n;
+  }
+}
+}  // anonymous namespace
+
+void* CacheAligned::operator new(size_t size) {
+  void* ptr;
+  if (posix_memalign(&ptr, METRIC_SHARD_SIZE, size) != 0) {
+    throw bad_alloc();
+  }
+  return ptr;
+}
+
+void CacheAligned::operator delete(void* ptr) {
+  free(ptr);
+}
+
+uint64_t Counter::value() const {
+  uint64_t total = 0;
+  for (const auto& shard : shards_) {
+    total += shard.value.load(memory_order_relaxed);
+  }
+  return total;
+}
+
+vector<uint64_t> Histogram::buckets(uint64_t& sum) const {
+  vector<uint64_t> cumulative(NUM_BUCKETS, 0);
+  sum = 0;
+  for (const auto& shard : shards_) {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+      cumulative[i] += shard.buckets[i].load(memory_order_relaxed);
+    }
+    sum += shard.sum.load(memory_order_relaxed);
+  }
+  for (size_t i = 1; i < NUM_BUCKETS; ++i) {
+    cumulative[i] += cumulative[i - 1];
+  }
+  return cumulative;
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::find_or_add(
+    Kind kind, const string& name, const string& help, const string& labels) {
+  lock_guard<mutex> guard(mutex_);
+  for (auto& entry : entries_) {
+    if (entry->name == name && entry->labels == labels) {
+      CHECK (entry->kind == kind) << "metric " << name << " re-registered as another type";
+      return *entry;
+    }
+  }
+  entries_.emplace_back(new Entry{kind, name, help, labels, nullptr, nullptr, nullptr});
+  return *entries_.back();
+}
+
+Counter& MetricsRegistry::counter(const string& name, const string& help,
+                                  const string& labels) {
+  Entry& entry = find_or_add(Kind::COUNTER, name, help, labels);
+  if (!entry.counter) {
+    entry.counter.reset(new Counter());
+  }
+  return *entry.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const string& name, const string& help,
+                              const string& labels) {
+  Entry& entry = find_or_add(Kind::GAUGE, name, help, labels);
+  if (!entry.gauge) {
+    entry.gauge.reset(new Gauge());
+  }
+  return *entry.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const string& name, const string& help,
+                                      const string& labels) {
+  Entry& entry = find_or_add(Kind::HISTOGRAM, name, help, labels);
+  if (!entry.histogram) {
+    entry.histogram.reset(new Histogram());
+  }
+  return *entry.histogram;
+}
+
+string MetricsRegistry::render() const {
+  lock_guard<mutex> guard(mutex_);
+  ostringstream out;
+  // Enough digits to round-trip a double; with the default 6 a timestamp
+  // gauge such as the last tick's receive time would be cut to 1E4 s.
+  out << setprecision(numeric_limits<double>::max_digits10);
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = *entries_[i];
+    bool first_of_name = true;
+    for (size_t j = 0; j < i; ++j) {
+      if (entries_[j]->name == entry.name) {
+        first_of_name = false;
+        break;
+      }
+    }
+    if (first_of_name) {
+      out << "# HELP " << entry.name << " " << entry.help << "\n"
+          << "# TYPE " << entry.name << " "
+          << KIND_NAMES[static_cast<int>(entry.kind)] << "\n";
+    }
+    switch (entry.kind) {
+      case Kind::COUNTER:
+        out << with_labels(entry.name, entry.labels) << " "
+            << entry.counter->value() << "\n";
+        break;
+      case Kind::GAUGE:
+        out << with_labels(entry.name, entry.labels) << " "
+            << entry.gauge->value() << "\n";
+        break;
+      case Kind::HISTOGRAM: {
+        uint64_t sum;
+        const vector<uint64_t> buckets = entry.histogram->buckets(sum);
+        const uint64_t count = buckets.back();
+        for (size_t b = 0; b < buckets.size() && (b == 0 || buckets[b - 1] < count); ++b) {
+          out << with_labels(entry.name + "_bucket", entry.labels,
+                             "le=\"" + to_string(uint64_t{1} << b) + "\"")
+              << " " << buckets[b] << "\n";
+        }
+        out << with_labels(entry.name + "_bucket", entry.labels, "le=\"+Inf\"")
+            << " " << count << "\n"
+            << with_labels(entry.name + "_sum", entry.labels) << " " << sum << "\n"
+            << with_labels(entry.name + "_count", entry.labels) << " " << count << "\n";
+        break;
+      }
+    }
+  }
+  return out.str();
+}
+
+MetricsServer::MetricsServer(uint16_t port, MetricsRegistry& registry)
+    : registry_(registry), fd_(socket(AF_INET, SOCK_STREAM, 0)), running_(true) {
+  PCHECK (fd_ >= 0) << "could not create metrics socket";
+  const int reuse = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  PCHECK (::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+      << "could not bind metrics port " << port;
+  PCHECK (listen(fd_, 16) == 0) << "could not listen on metrics port " << port;
+  thread_ = thread(&MetricsServer::serve, this);
+  LOG(INFO) << "serving metrics on http://127.0.0.1:" << port << "/metrics";
+}
+
+MetricsServer::~MetricsServer() {
+  running_ = false;
+  thread_.join();
+  close(fd_);
+}
+
+void MetricsServer::serve() {
+  pollfd listener{fd_, POLLIN, 0};
+  char request[MAX_REQUEST_SIZE];
+  while (running_) {
+    if (poll(&listener, 1, ACCEPT_POLL_MS) <= 0) {
+      continue;
+    }
+    const int client = accept(fd_, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    // The request itself is not interpreted, every path gets the metrics.
+    pollfd readable{client, POLLIN, 0};
+    if (poll(&readable, 1, ACCEPT_POLL_MS) > 0) {
+      recv(client, request, sizeof(request), 0);
+    }
+    const string body = registry_.render();
+    ostringstream response;
+    response << "HTTP/1.0 200 OK\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    send_all(client, response.str());
+    close(client);
+  }
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace btc_arb {
+
+constexpr size_t METRIC_SHARDS = 16;
+constexpr size_t METRIC_SHARD_SIZE = 64;
+
+// Index of the calling thread's shard. Threads are spread round-robin, so
+// shards are uncontended as long as there are fewer than METRIC_SHARDS
+// threads updating a metric.
+extern std::atomic<size_t> next_metric_shard;
+
+inline size_t metric_shard() {
+  thread_local size_t shard =
+      next_metric_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+  return shard;
+}
+
+// Base for metrics holding cache-line aligned shards. operator new keeps
+// that alignment on the heap, which plain new does not guarantee in C++11.
+struct CacheAligned {
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+};
+
+// Monotonic counter, sharded per thread so increments from different
+// threads never bounce a cache line.
+class Counter : public CacheAligned {
+ public:
+  inline void inc(uint64_t n = 1) {
+    shards_[metric_shard()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+ private:
+  struct alignas(METRIC_SHARD_SIZE) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  Shard shards_[METRIC_SHARDS];
+};
+
+class Gauge {
+ public:
+  inline void set(double value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+  double value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0.0};
+};
+
+// Power-of-two buckets: bucket i counts values in (2^(i-1), 2^i].
+class Histogram : public CacheAligned {
+ public:
+  static constexpr size_t NUM_BUCKETS = 64;
+
+  inline void observe(uint64_t value) {
+    Shard& shard = shards_[metric_shard()];
+    const size_t bucket = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+  // Cumulative counts per bucket, plus the total sum.
+  std::vector<uint64_t> buckets(uint64_t& sum) const;
+
+ private:
+  struct alignas(METRIC_SHARD_SIZE) Shard {
+    Shard() { for (auto& bucket : buckets) bucket = 0; }
+
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> sum{0};
+  };
+  Shard shards_[METRIC_SHARDS];
+};
+
+// Process-wide set of named metrics, rendered in the Prometheus text
+// exposition format. Registration takes a lock and should happen outside
+// the hot path; the returned references stay valid for the process lifetime.
+// Registering the same name and labels twice returns the same metric.
+class MetricsRegistry {
+ public:
+  static MetricsRegistry& instance();
+
+  // labels are in Prometheus syntax without braces, e.g. type="quote"
+  Counter& counter(const std::string& name, const std::string& help,
+                   const std::string& labels = "");
+  Gauge& gauge(const std::string& name, const std::string& help,
+               const std::string& labels = "");
+  Histogram& histogram(const std::string& name, const std::string& help,
+                       const std::string& labels = "");
+
+  std::string render() const;
+
+ private:
+  enum class Kind { COUNTER, GAUGE, HISTOGRAM };
+  struct Entry {
+    Kind kind;
+    std::string name;
+    std::string help;
+    std::string labels;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Entry& find_or_add(Kind kind, const std::string& name,
+                     const std::string& help, const std::string& labels);
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+};
+
+// Serves MetricsRegistry::render() over HTTP on 127.0.0.1:port from a
+// background thread, whatever the request path.
+class MetricsServer {
+ public:
+  explicit MetricsServer(uint16_t port,
+                         MetricsRegistry& registry = MetricsRegistry::instance());
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer&) = delete;
+
+ private:
+  void serve();
+
+  MetricsRegistry& registry_;
+  int fd_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+}  // namespace btc_arb
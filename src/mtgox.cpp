@@ -0,0 +1,15 @@
+#include "mtgox.hpp"
+
+
+namespace btc_arb {
+namespace mtgox {
+
+constexpr const char* Venue::name;
+constexpr const char* Venue::channel_key;
+constexpr ChannelDef Venue::channels[];
+constexpr TradeFields Venue::trade_fields;
+constexpr QuoteFields Venue::quote_fields;
+constexpr const char* Venue::trade_types[];
+constexpr const char* Venue::quote_types[];
+
+}}  // namespace btc_arb::mtgox
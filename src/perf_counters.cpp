@@ -0,0 +1,158 @@
+#include "perf_counters.hpp"
+
+#include <glog/logging.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+constexpr const char* EnumStrings<PerfEvent>::names[];
+
+#ifdef BTC_ARB_PERF_COUNTERS
+namespace {
+struct EventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr EventConfig PERF_EVENT_CONFIGS[NUM_PERF_EVENTS] = {
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int open_event(const EventConfig& config) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0 /* this thread */,
+                 -1 /* any cpu */, -1 /* no group */, 0);
+}
+}  // anonymous namespace
+
+PerfCounters& PerfCounters::local() {
+  thread_local PerfCounters counters;
+  return counters;
+}
+
+PerfCounters::PerfCounters() {
+  // Set before opening anything: the loop may stop early, and cleanup must
+  // not close descriptors it never opened.
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    fds_[event] = -1;
+    pages_[event] = nullptr;
+  }
+  const long page_size = sysconf(_SC_PAGESIZE);
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    fds_[event] = open_event(PERF_EVENT_CONFIGS[event]);
+    if (fds_[event] < 0) {
+      PLOG(WARNING) << "perf event " << enum_name(static_cast<PerfEvent>(event))
+                    << " unavailable"
+                    << (event == 0 ? ", falling back to rdtsc" : "");
+      if (event == 0) {
+        break;
+      }
+      continue;
+    }
+    void* page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fds_[event], 0);
+    if (page != MAP_FAILED) {
+      pages_[event] = static_cast<perf_event_mmap_page*>(page);
+    }
+  }
+  if (fds_[0] < 0) {
+    for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+      if (fds_[event] >= 0) {
+        close(fds_[event]);
+      }
+      fds_[event] = -1;
+      pages_[event] = nullptr;
+    }
+  }
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    if (fds_[event] >= 0) {
+      events_ |= 1u << event;
+    }
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  const long page_size = sysconf(_SC_PAGESIZE);
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    if (pages_[event] != nullptr) {
+      munmap(pages_[event], page_size);
+    }
+    if (fds_[event] >= 0) {
+      close(fds_[event]);
+    }
+  }
+}
+
+uint64_t PerfCounters::read_syscall(size_t event) const {
+  uint64_t count = 0;
+  if (::read(fds_[event], &count, sizeof(count)) != sizeof(count)) {
+    return 0;
+  }
+  return count;
+}
+
+PerfStats::PerfStats(const string& name) : name_(name) {
+  for (auto& total : totals_) {
+    total = 0;
+  }
+}
+
+void PerfStats::report() const {
+  const uint64_t calls = calls_.load(memory_order_relaxed);
+  if (calls == 0) {
+    return;
+  }
+  uint64_t totals[NUM_PERF_EVENTS];
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    totals[event] = totals_[event].load(memory_order_relaxed);
+  }
+  // The measuring thread's events; this thread's may differ.
+  const uint32_t events = events_.load(memory_order_relaxed);
+  auto available = [events](PerfEvent event) {
+    return (events & (1u << static_cast<uint32_t>(event))) != 0;
+  };
+  ostringstream line;
+  line << fixed << setprecision(2) << "perf " << name_ << ": " << calls
+       << " calls";
+  if (!available(PerfEvent::CYCLES)) {
+    line << ", tsc/call " << static_cast<double>(totals[0]) / calls
+         << " (no perf events)";
+    LOG(INFO) << line.str();
+    return;
+  }
+  line << ", cycles/call " << static_cast<double>(totals[0]) / calls;
+  if (available(PerfEvent::INSTRUCTIONS) && totals[0] > 0) {
+    line << ", ipc " << static_cast<double>(totals[1]) / totals[0];
+  }
+  for (size_t event = 2; event < NUM_PERF_EVENTS; ++event) {
+    if (available(static_cast<PerfEvent>(event))) {
+      line << ", " << enum_name(static_cast<PerfEvent>(event)) << "/call "
+           << static_cast<double>(totals[event]) / calls;
+    }
+  }
+  LOG(INFO) << line.str();
+}
+#endif  // BTC_ARB_PERF_COUNTERS
+
+}  // namespace btc_arb
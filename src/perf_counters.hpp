@@ -0,0 +1,194 @@
+#pragma once
+
+#include "enum_utils.hpp"
+
+#ifdef BTC_ARB_PERF_COUNTERS
+#include <linux/perf_event.h>
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace btc_arb {
+
+// Instrumentation is compiled in with -DBTC_ARB_PERF_COUNTERS (cmake
+// -DPERF_COUNTERS=ON). Otherwise PERF_SCOPE expands to nothing, the plants
+// carry no perf state at all and the build needs no perf_event headers.
+#ifdef BTC_ARB_PERF_COUNTERS
+#define PERF_SCOPE_CONCAT_(a, b) a##b
+#define PERF_SCOPE_CONCAT(a, b) PERF_SCOPE_CONCAT_(a, b)
+#define PERF_SCOPE(stats)                                               \
+  ::btc_arb::PerfScope PERF_SCOPE_CONCAT(perf_scope_, __LINE__){stats}
+// Counts the scope as calls calls, e.g. the ticks of a batch; calls is an
+// lvalue read when the scope ends.
+#define PERF_SCOPE_N(stats, calls)                                      \
+  ::btc_arb::PerfScope PERF_SCOPE_CONCAT(perf_scope_, __LINE__){stats, &(calls)}
+#else
+#define PERF_SCOPE(stats)
+#define PERF_SCOPE_N(stats, calls)
+#endif
+
+constexpr uint64_t PERF_REPORT_COUNT = 1 << 20;
+
+enum class PerfEvent {
+  CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES
+};
+
+template<> struct EnumStrings<PerfEvent> {
+    static constexpr const char* names[] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+};
+
+constexpr size_t NUM_PERF_EVENTS = enum_size<PerfEvent>();
+
+#ifdef BTC_ARB_PERF_COUNTERS
+struct PerfSample {
+  uint64_t values[NUM_PERF_EVENTS];
+  // Bit per PerfEvent counted by the thread that took the sample; zero when
+  // values[0] is rdtsc.
+  uint32_t events;
+};
+
+// Hardware counters of the calling thread, opened with perf_event_open(2)
+// for user space only. Counters are read with rdpmc where the kernel allows
+// it and with read(2) otherwise. Without perf events (no PMU in a VM, or
+// perf_event_paranoid too strict) cycles are taken from rdtsc instead and
+// the other events read as zero.
+class PerfCounters {
+ public:
+  // The calling thread's counters, opened on first use.
+  static PerfCounters& local();
+
+  PerfCounters(const PerfCounters&) = delete;
+  ~PerfCounters();
+
+  // False when falling back to rdtsc.
+  bool hardware() const { return fds_[0] >= 0; }
+  bool available(PerfEvent event) const {
+    return fds_[static_cast<size_t>(event)] >= 0;
+  }
+  uint32_t events() const { return events_; }
+
+  inline void read(PerfSample& sample) const;
+
+ private:
+  PerfCounters();
+
+  inline uint64_t read_event(size_t event) const;
+  uint64_t read_syscall(size_t event) const;
+
+  int fds_[NUM_PERF_EVENTS];
+  perf_event_mmap_page* pages_[NUM_PERF_EVENTS];
+  uint32_t events_ = 0;
+};
+
+void PerfCounters::read(PerfSample& sample) const {
+  sample.events = events_;
+  if (!hardware()) {
+#if defined(__x86_64__) || defined(__i386__)
+    sample.values[0] = __builtin_ia32_rdtsc();
+#else
+    sample.values[0] = 0;
+#endif
+    for (size_t event = 1; event < NUM_PERF_EVENTS; ++event) {
+      sample.values[event] = 0;
+    }
+    return;
+  }
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    sample.values[event] = read_event(event);
+  }
+}
+
+uint64_t PerfCounters::read_event(size_t event) const {
+  if (fds_[event] < 0) {
+    return 0;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  // Self-monitoring through the mapped page, see perf_event_open(2).
+  const perf_event_mmap_page* page = pages_[event];
+  if (page != nullptr) {
+    uint32_t seq;
+    uint32_t index;
+    uint64_t count;
+    do {
+      seq = page->lock;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      index = page->index;
+      count = page->offset;
+      if (page->cap_user_rdpmc && index != 0) {
+        const unsigned shift = 64 - page->pmc_width;
+        const uint64_t raw = __builtin_ia32_rdpmc(index - 1);
+        count += static_cast<int64_t>(raw << shift) >> shift;
+      }
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (page->lock != seq);
+    if (page->cap_user_rdpmc && index != 0) {
+      return count;
+    }
+  }
+#endif
+  return read_syscall(event);
+}
+
+// Counter totals of one instrumented site, e.g. one handler. Updated by the
+// thread running the site; report() may be called from any thread and
+// reports the events that thread counts, not its own.
+class PerfStats {
+ public:
+  explicit PerfStats(const std::string& name);
+  PerfStats(const PerfStats&) = delete;
+
+  inline void add(const PerfSample& start, const PerfSample& end,
+                  uint64_t calls = 1);
+  // Logs calls, IPC and misses per call.
+  void report() const;
+
+ private:
+  const std::string name_;
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint32_t> events_{0};
+  std::atomic<uint64_t> totals_[NUM_PERF_EVENTS];
+};
+
+void PerfStats::add(const PerfSample& start, const PerfSample& end,
+                    uint64_t calls) {
+  // Single writer, so relaxed load/store pairs are enough.
+  calls_.store(calls_.load(std::memory_order_relaxed) + calls,
+               std::memory_order_relaxed);
+  events_.store(end.events, std::memory_order_relaxed);
+  for (size_t event = 0; event < NUM_PERF_EVENTS; ++event) {
+    totals_[event].store(totals_[event].load(std::memory_order_relaxed) +
+                         end.values[event] - start.values[event],
+                         std::memory_order_relaxed);
+  }
+}
+
+// Counts the enclosing scope into a PerfStats, as one call or as *calls;
+// use through PERF_SCOPE or PERF_SCOPE_N.
+class PerfScope {
+ public:
+  explicit PerfScope(PerfStats& stats, const size_t* calls = nullptr)
+      : stats_(stats), counters_(PerfCounters::local()), calls_(calls) {
+    counters_.read(start_);
+  }
+  ~PerfScope() {
+    PerfSample end;
+    counters_.read(end);
+    stats_.add(start_, end, calls_ != nullptr ? *calls_ : 1);
+  }
+
+  PerfScope(const PerfScope&) = delete;
+
+ private:
+  PerfStats& stats_;
+  const PerfCounters& counters_;
+  const size_t* calls_;
+  PerfSample start_;
+};
+#endif  // BTC_ARB_PERF_COUNTERS
+
+}  // namespace btc_arb
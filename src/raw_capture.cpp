@@ -0,0 +1,121 @@
+#include "raw_capture.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+
+RawCaptureWriter::RawCaptureWriter(const string& path) {
+  file_.open(path, ios::out | ios::binary | ios::trunc);
+  CHECK (file_.is_open()) << "could not open " << path;
+  file_.write(RAW_CAPTURE_MAGIC, RAW_MAGIC_SIZE);
+  offset_ = RAW_MAGIC_SIZE;
+}
+
+RawCaptureWriter::~RawCaptureWriter() {
+  RawIndexTrailer trailer{offset_, index_.size(), {}};
+  memcpy(trailer.magic, RAW_INDEX_MAGIC, RAW_MAGIC_SIZE);
+  file_.write(reinterpret_cast<const char*>(index_.data()),
+              index_.size() * sizeof(RawIndexEntry));
+  file_.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+}
+
+void RawCaptureWriter::write(const RawFrame& frame) {
+  max_wall_ = max(max_wall_, frame.wall);
+  if (index_.empty() || max_wall_ >= index_.back().wall + RAW_INDEX_PERIOD) {
+    index_.push_back(RawIndexEntry{max_wall_, offset_});
+  }
+  const RawFrameHeader header{frame.size, frame.connection, frame.mono, frame.wall};
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file_.write(frame.data, frame.size);
+  offset_ += sizeof(header) + frame.size;
+}
+
+RawCaptureReader::RawCaptureReader(const string& path) {
+  file_.open(path);
+  CHECK (file_.is_open()) << "could not map " << path;
+  const char* data = file_.data();
+  const uint64_t size = file_.size();
+  CHECK (size >= RAW_MAGIC_SIZE &&
+         memcmp(data, RAW_CAPTURE_MAGIC, RAW_MAGIC_SIZE) == 0)
+      << path << " is not a raw capture";
+
+  frames_end_ = size;
+  if (size >= RAW_MAGIC_SIZE + sizeof(RawIndexTrailer)) {
+    RawIndexTrailer trailer;
+    memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    if (memcmp(trailer.magic, RAW_INDEX_MAGIC, RAW_MAGIC_SIZE) == 0 &&
+        trailer.offset >= RAW_MAGIC_SIZE &&
+        trailer.offset + trailer.entries * sizeof(RawIndexEntry) +
+        sizeof(trailer) == size) {
+      frames_end_ = trailer.offset;
+      index_.resize(trailer.entries);
+      memcpy(index_.data(), data + trailer.offset,
+             trailer.entries * sizeof(RawIndexEntry));
+    }
+  }
+  if (frames_end_ == size) {
+    LOG(WARNING) << path << " has no index, rebuilding it";
+    uint64_t offset = RAW_MAGIC_SIZE;
+    RawFrame frame;
+    uint64_t max_wall = 0;
+    while (frame_at(offset, frame)) {
+      max_wall = max(max_wall, frame.wall);
+      if (index_.empty() || max_wall >= index_.back().wall + RAW_INDEX_PERIOD) {
+        index_.push_back(RawIndexEntry{max_wall, offset});
+      }
+      offset += sizeof(RawFrameHeader) + frame.size;
+    }
+    if (offset != size) {
+      LOG(WARNING) << path << " ends with a partial frame, ignoring it";
+    }
+    frames_end_ = offset;
+  }
+  offset_ = RAW_MAGIC_SIZE;
+}
+
+bool RawCaptureReader::frame_at(uint64_t offset, RawFrame& frame) const {
+  if (offset + sizeof(RawFrameHeader) > frames_end_) {
+    return false;
+  }
+  RawFrameHeader header;
+  memcpy(&header, file_.data() + offset, sizeof(header));
+  if (offset + sizeof(header) + header.size > frames_end_) {
+    return false;
+  }
+  frame.mono = header.mono;
+  frame.wall = header.wall;
+  frame.connection = header.connection;
+  frame.size = header.size;
+  frame.data = file_.data() + offset + sizeof(header);
+  return true;
+}
+
+bool RawCaptureReader::next(RawFrame& frame) {
+  if (!frame_at(offset_, frame)) {
+    return false;
+  }
+  offset_ += sizeof(RawFrameHeader) + frame.size;
+  return true;
+}
+
+// Every frame before an entry whose latest wall time is below wall was
+// received before it too, whatever the clock did in between.
+void RawCaptureReader::seek(uint64_t wall) {
+  auto after = lower_bound(
+      index_.begin(), index_.end(), wall,
+      [](const RawIndexEntry& entry, uint64_t time) { return entry.wall < time; });
+  offset_ = after == index_.begin() ? RAW_MAGIC_SIZE : (after - 1)->offset;
+  RawFrame frame;
+  while (frame_at(offset_, frame) && frame.wall < wall) {
+    offset_ += sizeof(RawFrameHeader) + frame.size;
+  }
+}
+
+}  // namespace btc_arb
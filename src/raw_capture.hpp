@@ -0,0 +1,116 @@
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Raw capture file: the magic, then one frame per received message,
+//   uint32 size, uint32 connection, uint64 monotonic ns, uint64 wall ns,
+//   size payload bytes exactly as received,
+// then, once the writer is closed, a sparse index of (wall ns, frame offset)
+// pairs and a trailer of uint64 index offset, uint64 index entries and the
+// index magic. Files without the footer, e.g. after a crash, are still
+// readable; their index is rebuilt by scanning the frames.
+//
+// The index holds the latest wall time of the frames so far rather than
+// the frame's own, so it stays sorted when the system clock steps back.
+constexpr char RAW_CAPTURE_MAGIC[] = "BTCRAW01";
+constexpr char RAW_INDEX_MAGIC[] = "BTCRAWIX";
+constexpr size_t RAW_MAGIC_SIZE = sizeof(RAW_CAPTURE_MAGIC) - 1;
+// At most one index entry per this much wall time.
+constexpr uint64_t RAW_INDEX_PERIOD = 1000000000;  // 1s
+
+struct RawFrameHeader {
+  uint32_t size;
+  uint32_t connection;
+  uint64_t mono;
+  uint64_t wall;
+};
+
+struct RawIndexEntry {
+  uint64_t wall;  // latest wall time up to and including the frame
+  uint64_t offset;
+};
+
+struct RawIndexTrailer {
+  uint64_t offset;
+  uint64_t entries;
+  char magic[RAW_MAGIC_SIZE];
+};
+
+// A received message, pointing at the payload bytes.
+struct RawFrame {
+  uint64_t mono;  // steady clock, ns
+  uint64_t wall;  // system clock, ns since the epoch
+  uint32_t connection;
+  uint32_t size;
+  const char* data;
+};
+
+using FrameHandler = std::function<void(const RawFrame&)>;
+
+inline uint64_t mono_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class RawCaptureWriter {
+ public:
+  explicit RawCaptureWriter(const std::string& path);
+  // Writes the index footer.
+  ~RawCaptureWriter();
+  RawCaptureWriter(const RawCaptureWriter&) = delete;
+
+  void write(const RawFrame& frame);
+
+ private:
+  std::ofstream file_;
+  uint64_t offset_;
+  uint64_t max_wall_ = 0;
+  std::vector<RawIndexEntry> index_;
+};
+
+// Memory-maps a capture and walks its frames; seek() jumps close to a time
+// through the index.
+class RawCaptureReader {
+ public:
+  explicit RawCaptureReader(const std::string& path);
+  RawCaptureReader(const RawCaptureReader&) = delete;
+
+  // Positions the reader on the first frame, in file order, received at or
+  // after wall time.
+  void seek(uint64_t wall);
+  // Fills frame and moves past it; false at the end of the frames.
+  bool next(RawFrame& frame);
+
+  const std::vector<RawIndexEntry>& index() const { return index_; }
+
+ private:
+  bool frame_at(uint64_t offset, RawFrame& frame) const;
+
+  boost::iostreams::mapped_file_source file_;
+  uint64_t frames_end_;  // start of the footer, or the file size
+  uint64_t offset_;
+  std::vector<RawIndexEntry> index_;
+};
+
+// Read-only streambuf over a payload, so parsers read frames in place.
+class PayloadBuf : public std::streambuf {
+ public:
+  PayloadBuf(const char* data, size_t size) {
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+};
+
+}  // namespace btc_arb
@@ -0,0 +1,135 @@
+#include "raw_capture.hpp"
+#include "ticker_plant.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+namespace {
+
+// Frames mostly a few hundred bytes, some over the low-latency ring's slot
+// capacity, received 0-50ms apart with the wall clock now and then stepping
+// back by up to 30s. Each frame's mono is its position in the file.
+class RawCaptureTest : public ::testing::Test {
+ protected:
+  RawCaptureTest() {
+    char name[] = "/tmp/raw_capture_test.XXXXXX";
+    const int fd = mkstemp(name);
+    EXPECT_GE(fd, 0);
+    close(fd);
+    path_ = name;
+
+    std::mt19937 rng(9);
+    uint64_t wall = 1370000000000000000;
+    frames_end_ = RAW_MAGIC_SIZE;
+    for (uint64_t i = 0; i < 5000; ++i) {
+      wall += rng() % 50000000;
+      if (rng() % 500 == 0) {
+        wall -= rng() % 30000000000;
+      }
+      walls_.push_back(wall);
+      const size_t large = RawMessage::MAX_SIZE + 1 + rng() % 20000;
+      std::string payload(rng() % 50 == 0 ? large : rng() % 300, '\0');
+      for (char& c : payload) {
+        c = static_cast<char>(rng());
+      }
+      payloads_.push_back(payload);
+      frames_end_ += sizeof(RawFrameHeader) + payload.size();
+    }
+    RawCaptureWriter writer(path_);
+    for (uint64_t i = 0; i < walls_.size(); ++i) {
+      writer.write(RawFrame{i, walls_[i], static_cast<uint32_t>(i % 3),
+                            static_cast<uint32_t>(payloads_[i].size()),
+                            payloads_[i].data()});
+    }
+  }
+
+  ~RawCaptureTest() { std::remove(path_.c_str()); }
+
+  // Reads from the reader's position to the end, checking every frame.
+  void expect_frames_from(RawCaptureReader& reader, uint64_t first,
+                          uint64_t end) {
+    RawFrame frame;
+    uint64_t i = first;
+    for (; reader.next(frame); ++i) {
+      ASSERT_LT(i, end);
+      ASSERT_EQ(i, frame.mono);
+      ASSERT_EQ(walls_[i], frame.wall);
+      ASSERT_EQ(i % 3, frame.connection);
+      ASSERT_EQ(payloads_[i], std::string(frame.data, frame.size));
+    }
+    EXPECT_EQ(end, i);
+  }
+
+  // Every seek lands on the first frame in file order received at or after
+  // the sought time.
+  void expect_seeks(RawCaptureReader& reader, uint64_t end) {
+    std::mt19937 rng(4);
+    for (int q = 0; q < 3000; ++q) {
+      const uint64_t target = walls_[rng() % end] - 1 + rng() % 3;
+      uint64_t expected = 0;
+      while (expected < end && walls_[expected] < target) {
+        ++expected;
+      }
+      reader.seek(target);
+      RawFrame frame;
+      if (expected == end) {
+        EXPECT_FALSE(reader.next(frame)) << "seek to " << target;
+      } else {
+        ASSERT_TRUE(reader.next(frame)) << "seek to " << target;
+        EXPECT_EQ(expected, frame.mono) << "seek to " << target;
+      }
+    }
+    reader.seek(0);
+    expect_frames_from(reader, 0, end);
+  }
+
+  std::string path_;
+  std::vector<uint64_t> walls_;
+  std::vector<std::string> payloads_;
+  uint64_t frames_end_;
+};
+
+TEST_F(RawCaptureTest, RoundTripWithIndex) {
+  RawCaptureReader reader(path_);
+  ASSERT_FALSE(reader.index().empty());
+  for (size_t i = 1; i < reader.index().size(); ++i) {
+    EXPECT_LE(reader.index()[i - 1].wall, reader.index()[i].wall);
+  }
+  expect_frames_from(reader, 0, walls_.size());
+  expect_seeks(reader, walls_.size());
+}
+
+// As left by a crash: no footer, and then a partly written last frame.
+TEST_F(RawCaptureTest, RoundTripWithoutIndex) {
+  std::vector<RawIndexEntry> written_index;
+  {
+    RawCaptureReader reader(path_);
+    written_index = reader.index();
+  }
+  ASSERT_EQ(0, truncate(path_.c_str(), frames_end_));
+  {
+    RawCaptureReader reader(path_);
+    ASSERT_EQ(written_index.size(), reader.index().size());
+    for (size_t i = 0; i < written_index.size(); ++i) {
+      EXPECT_EQ(written_index[i].wall, reader.index()[i].wall);
+      EXPECT_EQ(written_index[i].offset, reader.index()[i].offset);
+    }
+    expect_frames_from(reader, 0, walls_.size());
+    expect_seeks(reader, walls_.size());
+  }
+
+  ASSERT_EQ(0, truncate(path_.c_str(), frames_end_ - 1));
+  RawCaptureReader reader(path_);
+  expect_frames_from(reader, 0, walls_.size() - 1);
+  expect_seeks(reader, walls_.size() - 1);
+}
+
+}  // anonymous namespace
+}  // namespace btc_arb
@@ -0,0 +1,140 @@
+#include "ticker_plant.hpp"
+#include "log_reporter.hpp"
+
+#include <boost/program_options.hpp>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace btc_arb;
+
+namespace {
+// Writes num_ticks quotes and trades around a random-walk price.
+void write_ticks(const string& path, uint64_t num_ticks) {
+  ofstream out(path, ios::out | ios::binary | ios::trunc);
+  CHECK (out.is_open()) << "could not open " << path;
+  mt19937 rng(1);
+  int32_t price = 10000000;
+  vector<Tick> batch;
+  batch.reserve(TICK_BATCH_SIZE);
+  for (uint64_t i = 0; i < num_ticks; ++i) {
+    price += static_cast<int32_t>(rng() % 3) - 1;
+    const uint64_t received = 1370000000000000000 + i * 1000;
+    if (rng() % 8 == 0) {
+      Trade trade{};
+      trade.received = received;
+      trade.ex_time = received / 1000;
+      trade.type = rng() % 2 ? Trade::Type::BID : Trade::Type::ASK;
+      trade.amount_int = 1 + rng() % 100000000;
+      trade.price_int = price;
+      batch.push_back(Tick(trade));
+    } else {
+      Quote quote{};
+      quote.received = received;
+      quote.ex_time = received / 1000;
+      quote.type = rng() % 2 ? Quote::Type::BID_UPDATE
+                             : Quote::Type::ASK_UPDATE;
+      quote.total_volume_int = rng() % 1000000000;
+      quote.price_int = price + static_cast<int32_t>(rng() % 200) - 100;
+      batch.push_back(Tick(quote));
+    }
+    if (batch.size() == batch.capacity() || i + 1 == num_ticks) {
+      out.write(reinterpret_cast<const char*>(batch.data()),
+                batch.size() * sizeof(Tick));
+      batch.clear();
+    }
+  }
+}
+}  // anonymous namespace
+
+// Replays a flat file through FileTickerPlant with the progress reporters
+// and/or per-tick handlers attached, and reports the best of several runs.
+int main(int argc, char** argv) {
+  namespace po = boost::program_options;
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+
+  uint64_t num_ticks{20000000};
+  string path;
+  uint32_t runs{3};
+  uint32_t per_tick{0};
+  bool progress{false};
+  auto description = po::options_description{
+    "Flat replay benchmark\n\nusage: " + string(argv[0]) + " [OPTIONS]"};
+  description.add_options()
+      ("help,h", "prints this help message")
+      ("file", po::value<string>(&path)->value_name("PATH"),
+       "flat file to replay; default is a synthetic file of --ticks ticks")
+      ("ticks", po::value<uint64_t>(&num_ticks)->value_name("N"),
+       "ticks in the synthetic file")
+      ("runs", po::value<uint32_t>(&runs)->value_name("N"),
+       "replays to take the best of")
+      ("progress", po::bool_switch(&progress),
+       "attaches report_progress_time and report_progress_block")
+      ("per-tick", po::value<uint32_t>(&per_tick)->value_name("N"),
+       "attaches N per-tick handlers, run through the adapter");
+  po::variables_map variables;
+  try {
+    po::store(po::parse_command_line(argc, argv, description), variables);
+    po::notify(variables);
+  } catch (const po::error& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  }
+  if (variables.count("help")) {
+    cerr << description << endl;
+    return 0;
+  }
+
+  const bool synthetic = path.empty();
+  if (synthetic) {
+    char name[] = "/tmp/replay_bench.XXXXXX";
+    const int fd = mkstemp(name);
+    CHECK (fd >= 0) << "could not create a temporary file";
+    close(fd);
+    path = name;
+    write_ticks(path, num_ticks);
+  }
+
+  double best = 0;
+  uint64_t ticks = 0;
+  for (uint32_t run = 0; run < runs; ++run) {
+    FileTickerPlant<FlatParser> plant(path);
+    uint64_t seen = 0;
+    plant.add_batch_handler([&seen](TickSpan span) { seen += span.size; });
+    if (progress) {
+      plant.add_batch_handler(report_progress_time);
+      plant.add_batch_handler(report_progress_block);
+    }
+    vector<uint64_t> sums(per_tick);
+    for (uint32_t i = 0; i < per_tick; ++i) {
+      uint64_t* sum = &sums[i];
+      plant.add_tick_handler([sum](const Tick& tick) {
+          *sum += tick_received(tick);
+        });
+    }
+    const auto start = chrono::steady_clock::now();
+    plant.run();
+    const double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    best = run == 0 ? seconds : min(best, seconds);
+    ticks = seen;
+  }
+  if (synthetic) {
+    remove(path.c_str());
+  }
+  cout << ticks << " ticks, best of " << runs << ": " << best << "s, "
+       << ticks / best / 1E6 << "M ticks/s" << endl;
+  return 0;
+}
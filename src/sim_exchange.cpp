@@ -0,0 +1,499 @@
+#include "sim_exchange.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+constexpr const char* EnumStrings<Side>::names[];
+constexpr const char* EnumStrings<OrderType>::names[];
+constexpr const char* EnumStrings<OrderStatus>::names[];
+constexpr uint32_t SimExchange::NIL;
+
+namespace {
+// Validates the ladder before it sizes the level arrays.
+uint32_t ladder_levels(const SimExchangeConfig& config) {
+  CHECK (config.price_step > 0) << "price_step must be positive";
+  CHECK (config.max_price_int > config.min_price_int) << "empty price ladder";
+  return (static_cast<int64_t>(config.max_price_int) - config.min_price_int) /
+      config.price_step;
+}
+}  // anonymous namespace
+
+SimExchange::LevelSet::LevelSet(uint32_t size)
+    : words_((size + 63) / 64), summary_((words_.size() + 63) / 64) {}
+
+void SimExchange::LevelSet::insert(uint32_t level) {
+  words_[level >> 6] |= uint64_t{1} << (level & 63);
+  summary_[level >> 12] |= uint64_t{1} << ((level >> 6) & 63);
+}
+
+void SimExchange::LevelSet::erase(uint32_t level) {
+  uint64_t& word = words_[level >> 6];
+  word &= ~(uint64_t{1} << (level & 63));
+  if (word == 0) {
+    summary_[level >> 12] &= ~(uint64_t{1} << ((level >> 6) & 63));
+  }
+}
+
+uint32_t SimExchange::LevelSet::floor(uint32_t level) const {
+  size_t word = level >> 6;
+  if (word >= words_.size()) {
+    return floor(words_.size() * 64 - 1);
+  }
+  const uint64_t bits = words_[word] & (~uint64_t{0} >> (63 - (level & 63)));
+  if (bits != 0) {
+    return (word << 6) + 63 - __builtin_clzll(bits);
+  }
+  if (word == 0) {
+    return NIL;
+  }
+  --word;
+  size_t group = word >> 6;
+  uint64_t summary = summary_[group] & (~uint64_t{0} >> (63 - (word & 63)));
+  while (summary == 0) {
+    if (group == 0) {
+      return NIL;
+    }
+    summary = summary_[--group];
+  }
+  word = (group << 6) + 63 - __builtin_clzll(summary);
+  return (word << 6) + 63 - __builtin_clzll(words_[word]);
+}
+
+uint32_t SimExchange::LevelSet::ceil(uint32_t level) const {
+  size_t word = level >> 6;
+  if (word >= words_.size()) {
+    return NIL;
+  }
+  const uint64_t bits = words_[word] & (~uint64_t{0} << (level & 63));
+  if (bits != 0) {
+    return (word << 6) + __builtin_ctzll(bits);
+  }
+  if (++word == words_.size()) {
+    return NIL;
+  }
+  size_t group = word >> 6;
+  uint64_t summary = summary_[group] & (~uint64_t{0} << (word & 63));
+  while (summary == 0) {
+    if (++group == summary_.size()) {
+      return NIL;
+    }
+    summary = summary_[group];
+  }
+  word = (group << 6) + __builtin_ctzll(summary);
+  return (word << 6) + __builtin_ctzll(words_[word]);
+}
+
+SimExchange::SimExchange(const SimExchangeConfig& config)
+    : config_(config),
+      num_levels_(ladder_levels(config)),
+      bids_(num_levels_), asks_(num_levels_),
+      market_bids_(num_levels_), market_asks_(num_levels_),
+      our_bid_levels_(num_levels_), our_ask_levels_(num_levels_),
+      orders_(config.max_orders) {
+  CHECK (config_.max_orders < NIL) << "too many orders";
+  free_.reserve(orders_.size());
+  for (uint32_t i = orders_.size(); i > 0; --i) {
+    orders_[i - 1].generation = 1;
+    orders_[i - 1].state = OrderState::FREE;
+    free_.push_back(i - 1);
+  }
+}
+
+void SimExchange::add_fill_handler(FillHandler&& handler) {
+  handlers_.emplace_back(move(handler));
+}
+
+void SimExchange::add_order_handler(OrderHandler&& handler) {
+  order_handlers_.emplace_back(move(handler));
+}
+
+bool SimExchange::to_level(int32_t price_int, uint32_t& level) const {
+  if (price_int < config_.min_price_int || price_int >= config_.max_price_int) {
+    return false;
+  }
+  level = (price_int - config_.min_price_int) / config_.price_step;
+  return level < num_levels_;
+}
+
+int32_t SimExchange::to_price(uint32_t level) const {
+  return config_.min_price_int + static_cast<int32_t>(level) * config_.price_step;
+}
+
+uint64_t SimExchange::order_id(uint32_t index) const {
+  return (static_cast<uint64_t>(orders_[index].generation) << 32) | index;
+}
+
+vector<SimExchange::Level>& SimExchange::book(Side side) {
+  return side == Side::BUY ? bids_ : asks_;
+}
+
+int64_t SimExchange::visible_volume(Side side, int32_t price_int) const {
+  uint32_t level;
+  if (!to_level(price_int, level)) {
+    return 0;
+  }
+  return side == Side::BUY ? bids_[level].visible : asks_[level].visible;
+}
+
+uint64_t SimExchange::submit(Side side, int64_t amount_int, int32_t price_int,
+                             OrderType type) {
+  uint32_t level = 0;
+  if (amount_int <= 0 || free_.empty()) {
+    return 0;
+  }
+  if (type == OrderType::LIMIT &&
+      (!to_level(price_int, level) || price_int != to_price(level))) {
+    return 0;
+  }
+  const uint32_t index = free_.back();
+  free_.pop_back();
+  Order& order = orders_[index];
+  order.next = order.prev = NIL;
+  order.level = level;
+  order.state = OrderState::PENDING;
+  order.side = side;
+  order.type = type;
+  order.open_int = amount_int;
+  order.queue_ahead = 0;
+  const uint64_t id = order_id(index);
+  actions_.push_back(Action{now_ + config_.order_latency, id, false});
+  return id;
+}
+
+bool SimExchange::cancel(uint64_t order_id) {
+  const uint32_t index = order_id & 0xffffffff;
+  if (index >= orders_.size() ||
+      orders_[index].generation != (order_id >> 32) ||
+      (orders_[index].state != OrderState::PENDING &&
+       orders_[index].state != OrderState::ACTIVE)) {
+    return false;
+  }
+  actions_.push_back(Action{now_ + config_.order_latency, order_id, true});
+  return true;
+}
+
+void SimExchange::on_tick(const Tick& tick) {
+  if (tick.type == Tick::Type::QUOTE) {
+    const Quote& quote = tick.as<Quote>();
+    if (quote.cyc == config_.cyc) {
+      advance(quote.received);
+      on_quote(quote);
+      advance(quote.received);
+    }
+  } else if (tick.type == Tick::Type::TRADE) {
+    const Trade& trade = tick.as<Trade>();
+    if (trade.cyc == config_.cyc) {
+      advance(trade.received);
+      on_trade(trade);
+      advance(trade.received);
+    }
+  }
+}
+
+void SimExchange::advance(uint64_t time) {
+  while (true) {
+    const bool action_due = !actions_.empty() && actions_.front().time <= time;
+    const bool report_due = !reports_.empty() && reports_.front().time() <= time;
+    if (action_due &&
+        (!report_due || actions_.front().time <= reports_.front().time())) {
+      const Action action = actions_.front();
+      actions_.pop_front();
+      now_ = max(now_, action.time);
+      const uint32_t index = action.id & 0xffffffff;
+      Order& order = orders_[index];
+      if (order.generation != (action.id >> 32)) {
+        // Already filled or released; a cancel still gets its answer.
+        if (action.cancel) {
+          report(action.id, OrderStatus::REJECTED, 0);
+        }
+        continue;
+      }
+      if (!action.cancel) {
+        activate(index);
+      } else if (order.state == OrderState::PENDING) {
+        order.state = OrderState::CANCELLED;
+        report(action.id, OrderStatus::CANCELLED, order.open_int);
+      } else if (order.state == OrderState::ACTIVE) {
+        report(action.id, OrderStatus::CANCELLED, order.open_int);
+        unlink(index);
+        release(index);
+      } else {
+        report(action.id, OrderStatus::REJECTED, 0);  // cancelled twice
+      }
+    } else if (report_due) {
+      const Report report = reports_.front();
+      reports_.pop_front();
+      if (report.is_fill) {
+        for (auto& handler : handlers_) {
+          handler(report.fill);
+        }
+      } else {
+        for (auto& handler : order_handlers_) {
+          handler(report.update);
+        }
+      }
+    } else {
+      break;
+    }
+  }
+  now_ = max(now_, time);
+}
+
+void SimExchange::activate(uint32_t index) {
+  Order& order = orders_[index];
+  if (order.state == OrderState::CANCELLED) {
+    release(index);
+    return;
+  }
+  if (order.type == OrderType::MARKET) {
+    take(index, -1);
+    if (order.open_int > 0) {
+      report(order_id(index), OrderStatus::EXPIRED, order.open_int);
+    }
+    release(index);
+    return;
+  }
+  take(index, order.level);
+  if (order.open_int == 0) {
+    release(index);
+    return;
+  }
+  order.state = OrderState::ACTIVE;
+  order.queue_ahead = book(order.side)[order.level].visible;
+  link(index);
+  report(order_id(index), OrderStatus::ACCEPTED, order.open_int);
+}
+
+// Executes against the visible opposite side up to limit_level (-1 for
+// no limit), consuming the volume it takes.
+void SimExchange::take(uint32_t index, int32_t limit_level) {
+  Order& order = orders_[index];
+  if (order.side == Side::BUY) {
+    while (order.open_int > 0 && market_best_ask_ != NIL &&
+           (limit_level < 0 || market_best_ask_ <= static_cast<uint32_t>(limit_level))) {
+      const uint32_t level = market_best_ask_;
+      const int64_t amount = min(order.open_int, asks_[level].visible);
+      fill(index, to_price(level), amount, false);
+      asks_[level].visible -= amount;
+      update_market_best(Side::SELL, level);
+    }
+  } else {
+    while (order.open_int > 0 && market_best_bid_ != NIL &&
+           (limit_level < 0 || market_best_bid_ >= static_cast<uint32_t>(limit_level))) {
+      const uint32_t level = market_best_bid_;
+      const int64_t amount = min(order.open_int, bids_[level].visible);
+      fill(index, to_price(level), amount, false);
+      bids_[level].visible -= amount;
+      update_market_best(Side::BUY, level);
+    }
+  }
+}
+
+void SimExchange::fill(uint32_t index, int32_t price_int, int64_t amount_int,
+                       bool maker) {
+  Order& order = orders_[index];
+  order.open_int -= amount_int;
+  Report report{};
+  report.is_fill = true;
+  report.fill = Fill{order_id(index), now_, now_ + config_.fill_latency,
+                     order.side, price_int, amount_int, order.open_int, maker};
+  reports_.push_back(report);
+}
+
+void SimExchange::report(uint64_t id, OrderStatus status,
+                         int64_t remaining_int) {
+  Report report{};
+  report.is_fill = false;
+  report.update = OrderUpdate{id, now_, now_ + config_.fill_latency, status,
+                              remaining_int};
+  reports_.push_back(report);
+}
+
+void SimExchange::on_quote(const Quote& quote) {
+  uint32_t level;
+  if (!to_level(quote.price_int, level)) {
+    return;
+  }
+  const Side side = quote.type == Quote::Type::BID_UPDATE ? Side::BUY : Side::SELL;
+  Level& lvl = book(side)[level];
+  const int64_t old_visible = lvl.visible;
+  // Trades beyond the visible volume (hidden or already-removed orders)
+  // never show up as a depth reduction here; left over, they would pass
+  // later genuine cancels off as trades.
+  lvl.traded = min(lvl.traded, old_visible);
+  // Off-grid prices share a level, so only their deltas can be applied.
+  if (quote.price_int == to_price(level)) {
+    lvl.visible = quote.total_volume_int;
+  } else {
+    lvl.visible = max<int64_t>(0, lvl.visible + quote.delta_volume_int);
+  }
+  const int64_t reduction = old_visible - lvl.visible;
+  if (reduction > 0) {
+    const int64_t traded = min(reduction, lvl.traded);
+    const int64_t cancelled = reduction - traded;
+    lvl.traded -= traded;
+    for (uint32_t i = lvl.head; i != NIL; i = orders_[i].next) {
+      Order& order = orders_[i];
+      if (cancelled > 0) {
+        order.queue_ahead -= static_cast<int64_t>(
+            static_cast<double>(order.queue_ahead) * cancelled / old_visible);
+      }
+      order.queue_ahead = min(order.queue_ahead, lvl.visible);
+    }
+  }
+  if (lvl.visible == 0) {
+    lvl.traded = 0;
+  }
+  update_market_best(side, level);
+}
+
+void SimExchange::on_trade(const Trade& trade) {
+  uint32_t trade_level;
+  if (!to_level(trade.price_int, trade_level)) {
+    return;
+  }
+  // A seller-initiated trade fills our bids at or above its price, a
+  // buyer-initiated one our asks at or below it.
+  const Side resting = trade.type == Trade::Type::ASK ? Side::BUY : Side::SELL;
+  vector<Level>& levels = book(resting);
+  levels[trade_level].traded += trade.amount_int;
+  int64_t volume = trade.amount_int;
+
+  // Our levels from the best down to the trade's, skipping empty ones.
+  for (uint32_t level = resting == Side::BUY ? our_best_bid_ : our_best_ask_;
+       volume > 0 && level != NIL &&
+           (resting == Side::BUY ? level >= trade_level : level <= trade_level);
+       level = our_next(resting, level)) {
+    int64_t market_consumed = 0;
+    uint32_t i = levels[level].head;
+    while (i != NIL) {
+      Order& order = orders_[i];
+      const uint32_t next = order.next;
+      if (level == trade_level) {
+        // Market volume queued ahead of us trades first.
+        order.queue_ahead -= min(order.queue_ahead, market_consumed);
+        const int64_t ahead = min(volume, order.queue_ahead);
+        order.queue_ahead -= ahead;
+        market_consumed += ahead;
+        volume -= ahead;
+      }
+      const int64_t amount = min(volume, order.open_int);
+      if (amount > 0) {
+        fill(i, to_price(level), amount, true);
+        volume -= amount;
+        if (order.open_int == 0) {
+          unlink(i);
+          release(i);
+        }
+      }
+      i = next;
+    }
+    if (level == trade_level) {
+      break;
+    }
+  }
+}
+
+void SimExchange::link(uint32_t index) {
+  Order& order = orders_[index];
+  Level& level = book(order.side)[order.level];
+  order.prev = level.tail;
+  order.next = NIL;
+  if (level.tail != NIL) {
+    orders_[level.tail].next = index;
+  } else {
+    level.head = index;
+  }
+  level.tail = index;
+  if (order.side == Side::BUY) {
+    our_bid_levels_.insert(order.level);
+    if (our_best_bid_ == NIL || order.level > our_best_bid_) {
+      our_best_bid_ = order.level;
+    }
+  } else {
+    our_ask_levels_.insert(order.level);
+    if (our_best_ask_ == NIL || order.level < our_best_ask_) {
+      our_best_ask_ = order.level;
+    }
+  }
+}
+
+void SimExchange::unlink(uint32_t index) {
+  Order& order = orders_[index];
+  vector<Level>& levels = book(order.side);
+  Level& level = levels[order.level];
+  if (order.prev != NIL) {
+    orders_[order.prev].next = order.next;
+  } else {
+    level.head = order.next;
+  }
+  if (order.next != NIL) {
+    orders_[order.next].prev = order.prev;
+  } else {
+    level.tail = order.prev;
+  }
+  order.next = order.prev = NIL;
+  if (level.head != NIL) {
+    return;
+  }
+  // The level emptied; move our best to the next level still holding orders.
+  uint32_t& best = order.side == Side::BUY ? our_best_bid_ : our_best_ask_;
+  if (order.side == Side::BUY) {
+    our_bid_levels_.erase(order.level);
+  } else {
+    our_ask_levels_.erase(order.level);
+  }
+  if (best == order.level) {
+    best = our_next(order.side, order.level);
+  }
+}
+
+uint32_t SimExchange::our_next(Side side, uint32_t level) const {
+  if (side == Side::BUY) {
+    return level == 0 ? NIL : our_bid_levels_.floor(level - 1);
+  }
+  return our_ask_levels_.ceil(level + 1);
+}
+
+void SimExchange::release(uint32_t index) {
+  Order& order = orders_[index];
+  order.state = OrderState::FREE;
+  ++order.generation;
+  free_.push_back(index);
+}
+
+void SimExchange::update_market_best(Side side, uint32_t level) {
+  if (side == Side::BUY) {
+    if (bids_[level].visible > 0) {
+      market_bids_.insert(level);
+      if (market_best_bid_ == NIL || level > market_best_bid_) {
+        market_best_bid_ = level;
+      }
+    } else {
+      market_bids_.erase(level);
+      if (level == market_best_bid_) {
+        market_best_bid_ = market_bids_.floor(level);
+      }
+    }
+  } else {
+    if (asks_[level].visible > 0) {
+      market_asks_.insert(level);
+      if (market_best_ask_ == NIL || level < market_best_ask_) {
+        market_best_ask_ = level;
+      }
+    } else {
+      market_asks_.erase(level);
+      if (level == market_best_ask_) {
+        market_best_ask_ = market_asks_.ceil(level);
+      }
+    }
+  }
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "ticker_plant.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <vector>
+
+
+namespace btc_arb {
+
+enum class Side { BUY, SELL };
+enum class OrderType { LIMIT, MARKET };
+
+// ACCEPTED: a limit order rests on the book, after any immediate fills.
+// CANCELLED: a cancel took effect. EXPIRED: the unfilled remainder of a
+// market order was dropped. REJECTED: a cancel reached the book after the
+// order had already ended, so it had no effect.
+enum class OrderStatus { ACCEPTED, CANCELLED, EXPIRED, REJECTED };
+
+template<> struct EnumStrings<Side> {
+    static constexpr const char* names[] = {"buy", "sell"};
+};
+
+template<> struct EnumStrings<OrderType> {
+    static constexpr const char* names[] = {"limit", "market"};
+};
+
+template<> struct EnumStrings<OrderStatus> {
+    static constexpr const char* names[] = {
+      "accepted", "cancelled", "expired", "rejected"};
+};
+
+struct Fill {
+  uint64_t order_id;
+  uint64_t exec_time;  // sim time of the match
+  uint64_t time;       // exec_time plus fill latency, when it is delivered
+  Side side;
+  int32_t price_int;
+  int64_t amount_int;
+  int64_t remaining_int;
+  bool maker;
+};
+
+// Order lifecycle events other than fills. An order that fills completely
+// ends with its last Fill (remaining_int 0) and gets no update.
+struct OrderUpdate {
+  uint64_t order_id;
+  uint64_t exec_time;  // sim time the book acted on the order
+  uint64_t time;       // exec_time plus fill latency, when it is delivered
+  OrderStatus status;
+  int64_t remaining_int;
+};
+
+using FillHandler = std::function<void(const Fill&)>;
+using OrderHandler = std::function<void(const OrderUpdate&)>;
+
+struct SimExchangeConfig {
+  Currency cyc = Currency::USD;
+  // Price ladder covered by the flat level arrays; orders must sit on a
+  // multiple of price_step inside [min_price_int, max_price_int).
+  int32_t min_price_int = 0;
+  int32_t max_price_int = 100000000;  // 1000 USD at 1E5
+  int32_t price_step = 1000;           // 0.01 USD
+  uint64_t order_latency = 0;  // ns from submit/cancel to reaching the book
+  uint64_t fill_latency = 0;   // ns from the book to a fill/update arriving
+  size_t max_orders = 1 << 16;
+};
+
+// Simulated exchange for backtests, driven by replayed Quote/Trade ticks on
+// one currency. Resting orders track the visible volume queued ahead of
+// them: trades at their price consume it first, and depth reductions not
+// explained by trades are treated as cancels spread proportionally over the
+// queue. Trade::Type::BID is taken as a buyer-initiated trade (it fills our
+// sells) and ASK as seller-initiated.
+//
+// Not thread-safe; parameter sweeps run one SimExchange per thread.
+class SimExchange {
+ public:
+  explicit SimExchange(const SimExchangeConfig& config);
+  SimExchange(const SimExchange&) = delete;
+
+  void add_fill_handler(FillHandler&& handler);
+  // Fills and order updates are delivered in the order the book produced
+  // them.
+  void add_order_handler(OrderHandler&& handler);
+
+  // Returns the order id, or 0 if the order is rejected (off the ladder,
+  // non-positive amount or the order pool is exhausted).
+  uint64_t submit(Side side, int64_t amount_int, int32_t price_int = 0,
+                  OrderType type = OrderType::LIMIT);
+  // Returns false if the order is unknown or already done. Otherwise the
+  // cancel is confirmed by a CANCELLED update, or answered with REJECTED
+  // if the order fills or is cancelled before the cancel reaches the book.
+  bool cancel(uint64_t order_id);
+
+  void on_tick(const Tick& tick);
+  // Applies pending actions and delivers fills and updates up to the given
+  // time.
+  void advance(uint64_t time);
+
+  uint64_t now() const { return now_; }
+  size_t open_orders() const { return orders_.size() - free_.size(); }
+  // Visible market volume at price_int; 0 off the ladder.
+  int64_t visible_volume(Side side, int32_t price_int) const;
+
+ private:
+  static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+  enum class OrderState : uint8_t { FREE, PENDING, ACTIVE, CANCELLED };
+
+  struct Order {
+    uint32_t generation;
+    uint32_t next;
+    uint32_t prev;
+    uint32_t level;
+    OrderState state;
+    Side side;
+    OrderType type;
+    int64_t open_int;
+    int64_t queue_ahead;
+  };
+
+  struct Level {
+    int64_t visible = 0;  // market volume from depth updates
+    int64_t traded = 0;   // traded here but not yet seen in depth, capped
+                          // at visible
+    uint32_t head = NIL;  // our resting orders, FIFO
+    uint32_t tail = NIL;
+  };
+
+  struct Action {
+    uint64_t time;
+    uint64_t id;
+    bool cancel;
+  };
+
+  // A fill or an order update waiting out the fill latency.
+  struct Report {
+    bool is_fill;
+    Fill fill;
+    OrderUpdate update;
+
+    uint64_t time() const { return is_fill ? fill.time : update.time; }
+  };
+
+  // Set of level indices with nearest-member lookups: a bit per level and a
+  // summary bit per 64-level word, so finding the next best level skips
+  // 4096 empty levels per step instead of one.
+  class LevelSet {
+   public:
+    explicit LevelSet(uint32_t size);
+
+    inline void insert(uint32_t level);
+    inline void erase(uint32_t level);
+    // Highest member <= level / lowest member >= level, NIL if none.
+    uint32_t floor(uint32_t level) const;
+    uint32_t ceil(uint32_t level) const;
+
+   private:
+    std::vector<uint64_t> words_;
+    std::vector<uint64_t> summary_;
+  };
+
+  inline bool to_level(int32_t price_int, uint32_t& level) const;
+  inline int32_t to_price(uint32_t level) const;
+  inline uint64_t order_id(uint32_t index) const;
+  inline std::vector<Level>& book(Side side);
+
+  void on_quote(const Quote& quote);
+  void on_trade(const Trade& trade);
+  void activate(uint32_t index);
+  void take(uint32_t index, int32_t limit_level);
+  void fill(uint32_t index, int32_t price_int, int64_t amount_int, bool maker);
+  void report(uint64_t id, OrderStatus status, int64_t remaining_int);
+  void link(uint32_t index);
+  void unlink(uint32_t index);
+  void release(uint32_t index);
+  void update_market_best(Side side, uint32_t level);
+  // Next level of ours after level, moving away from the best price.
+  uint32_t our_next(Side side, uint32_t level) const;
+
+  const SimExchangeConfig config_;
+  const uint32_t num_levels_;
+  std::vector<Level> bids_;
+  std::vector<Level> asks_;
+  // Levels with visible market volume, and levels holding our orders.
+  LevelSet market_bids_;
+  LevelSet market_asks_;
+  LevelSet our_bid_levels_;
+  LevelSet our_ask_levels_;
+  std::vector<Order> orders_;
+  std::vector<uint32_t> free_;
+  std::deque<Action> actions_;
+  std::deque<Report> reports_;
+  std::vector<FillHandler> handlers_;
+  std::vector<OrderHandler> order_handlers_;
+
+  uint64_t now_ = 0;
+  // Best level holding one of our orders, per side; NIL when none.
+  uint32_t our_best_bid_ = NIL;
+  uint32_t our_best_ask_ = NIL;
+  // Best level with visible market volume, per side; NIL when none.
+  uint32_t market_best_bid_ = NIL;
+  uint32_t market_best_ask_ = NIL;
+};
+
+}  // namespace btc_arb
@@ -0,0 +1,107 @@
+#include "sim_exchange.hpp"
+
+#include <boost/program_options.hpp>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+using namespace btc_arb;
+
+// Replays a synthetic book around a random-walk mid while a quoting loop
+// keeps orders resting on both sides, and reports orders and fills per
+// second.
+int main(int argc, char** argv) {
+  namespace po = boost::program_options;
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+
+  uint64_t num_ticks{10000000};
+  uint32_t seed{1};
+  uint32_t width{10};
+  auto description = po::options_description{
+    "SimExchange benchmark\n\nusage: " + string(argv[0]) + " [OPTIONS]"};
+  description.add_options()
+      ("help,h", "prints this help message")
+      ("ticks", po::value<uint64_t>(&num_ticks)->value_name("N"),
+       "ticks to replay")
+      ("seed", po::value<uint32_t>(&seed)->value_name("N"), "random seed")
+      ("width", po::value<uint32_t>(&width)->value_name("LEVELS"),
+       "quotes and orders land up to LEVELS from the mid; large values give "
+       "sparse books");
+  po::variables_map variables;
+  try {
+    po::store(po::parse_command_line(argc, argv, description), variables);
+    po::notify(variables);
+  } catch (const po::error& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  }
+  if (variables.count("help")) {
+    cerr << description << endl;
+    return 0;
+  }
+
+  SimExchangeConfig config;
+  SimExchange exchange{config};
+  uint64_t fills = 0;
+  exchange.add_fill_handler([&fills](const Fill&) { ++fills; });
+
+  mt19937 rng(seed);
+  CHECK (width > 0 && width < 50000) << "width must be in [1, 50000)";
+  int32_t mid = 50000;  // in levels
+  uint64_t orders = 0;
+  vector<uint64_t> resting;
+  const auto start = chrono::steady_clock::now();
+  for (uint64_t time = 1; time <= num_ticks; ++time) {
+    if (rng() % 64 == 0) {
+      mid += rng() % 2 ? 1 : -1;
+    }
+    const int32_t offset = 1 + rng() % width;
+    const bool bid = rng() % 2;
+    if (rng() % 8 == 0) {
+      Trade trade{};
+      trade.received = time;
+      trade.type = bid ? Trade::Type::ASK : Trade::Type::BID;
+      trade.amount_int = 1 + rng() % 100;
+      trade.cyc = config.cyc;
+      trade.price_int = config.price_step * (bid ? mid - offset : mid + offset);
+      exchange.on_tick(Tick(trade));
+    } else {
+      Quote quote{};
+      quote.received = time;
+      quote.type = bid ? Quote::Type::BID_UPDATE : Quote::Type::ASK_UPDATE;
+      quote.total_volume_int = rng() % 4 ? rng() % 1000 : 0;
+      quote.cyc = config.cyc;
+      quote.price_int = config.price_step * (bid ? mid - offset : mid + offset);
+      exchange.on_tick(Tick(quote));
+    }
+    if (time % 4 == 0) {
+      if (resting.size() >= 64) {
+        for (uint64_t id : resting) {
+          exchange.cancel(id);
+        }
+        resting.clear();
+      }
+      const bool buy = rng() % 2;
+      const uint64_t id = exchange.submit(
+          buy ? Side::BUY : Side::SELL, 1 + rng() % 50,
+          config.price_step * (buy ? mid - offset : mid + offset));
+      if (id != 0) {
+        resting.push_back(id);
+        ++orders;
+      }
+    }
+  }
+  const double seconds = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+  cout << num_ticks << " ticks, " << orders << " orders, " << fills
+       << " fills in " << seconds << "s: " << num_ticks / seconds / 1E6
+       << "M ticks/s, " << (orders + fills) / seconds / 1E6
+       << "M orders+fills/s" << endl;
+  return 0;
+}
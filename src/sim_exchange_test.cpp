@@ -0,0 +1,349 @@
+#include "sim_exchange.hpp"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+namespace {
+
+constexpr int32_t STEP = 1000;
+constexpr int32_t PRICE = 10000000;  // 100 USD
+
+Tick quote(uint64_t received, Side side, int32_t price_int, int64_t volume) {
+  Quote quote{};
+  quote.received = received;
+  quote.type = side == Side::BUY ? Quote::Type::BID_UPDATE
+                                 : Quote::Type::ASK_UPDATE;
+  quote.total_volume_int = volume;
+  quote.cyc = Currency::USD;
+  quote.price_int = price_int;
+  return Tick(quote);
+}
+
+// Trade::Type::ASK is seller-initiated and fills resting bids.
+Tick trade(uint64_t received, Trade::Type type, int32_t price_int,
+           int64_t amount) {
+  Trade trade{};
+  trade.received = received;
+  trade.type = type;
+  trade.amount_int = amount;
+  trade.cyc = Currency::USD;
+  trade.price_int = price_int;
+  return Tick(trade);
+}
+
+class SimExchangeTest : public ::testing::Test {
+ protected:
+  explicit SimExchangeTest(const SimExchangeConfig& config = SimExchangeConfig{})
+      : exchange_(config) {
+    exchange_.add_fill_handler([this](const Fill& fill) {
+        fills_.push_back(fill);
+        delivered_ += 'f';
+      });
+    exchange_.add_order_handler([this](const OrderUpdate& update) {
+        updates_.push_back(update);
+        delivered_ += 'u';
+      });
+  }
+
+  SimExchange exchange_;
+  std::vector<Fill> fills_;
+  std::vector<OrderUpdate> updates_;
+  std::string delivered_;  // 'f' per fill and 'u' per update, in order
+};
+
+TEST_F(SimExchangeTest, MarketableLimitTakesVisibleVolume) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 5));
+  exchange_.on_tick(quote(1, Side::SELL, PRICE + STEP, 5));
+  const uint64_t id = exchange_.submit(Side::BUY, 7, PRICE + STEP);
+  ASSERT_NE(0u, id);
+  exchange_.advance(2);
+
+  ASSERT_EQ(2u, fills_.size());
+  EXPECT_EQ(PRICE, fills_[0].price_int);
+  EXPECT_EQ(5, fills_[0].amount_int);
+  EXPECT_EQ(PRICE + STEP, fills_[1].price_int);
+  EXPECT_EQ(2, fills_[1].amount_int);
+  EXPECT_EQ(0, fills_[1].remaining_int);
+  EXPECT_FALSE(fills_[1].maker);
+  EXPECT_EQ(0, exchange_.visible_volume(Side::SELL, PRICE));
+  EXPECT_EQ(3, exchange_.visible_volume(Side::SELL, PRICE + STEP));
+  EXPECT_EQ(0u, exchange_.open_orders());
+  EXPECT_TRUE(updates_.empty());
+}
+
+TEST_F(SimExchangeTest, MarketOrderRemainderExpires) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 5));
+  const uint64_t partial = exchange_.submit(Side::BUY, 8, 0, OrderType::MARKET);
+  const uint64_t unfilled = exchange_.submit(Side::BUY, 2, 0, OrderType::MARKET);
+  exchange_.advance(2);
+
+  EXPECT_EQ("fuu", delivered_);
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(partial, fills_[0].order_id);
+  EXPECT_EQ(3, fills_[0].remaining_int);
+  ASSERT_EQ(2u, updates_.size());
+  EXPECT_EQ(partial, updates_[0].order_id);
+  EXPECT_EQ(OrderStatus::EXPIRED, updates_[0].status);
+  EXPECT_EQ(3, updates_[0].remaining_int);
+  EXPECT_EQ(unfilled, updates_[1].order_id);
+  EXPECT_EQ(OrderStatus::EXPIRED, updates_[1].status);
+  EXPECT_EQ(2, updates_[1].remaining_int);
+  EXPECT_EQ(0u, exchange_.open_orders());
+}
+
+TEST_F(SimExchangeTest, RestingOrderIsAcceptedThenCancelled) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 1));
+  const uint64_t id = exchange_.submit(Side::BUY, 3, PRICE);
+  exchange_.advance(2);
+  ASSERT_EQ(1u, updates_.size());
+  EXPECT_EQ(id, updates_[0].order_id);
+  EXPECT_EQ(OrderStatus::ACCEPTED, updates_[0].status);
+  EXPECT_EQ(2, updates_[0].remaining_int);
+
+  EXPECT_TRUE(exchange_.cancel(id));
+  exchange_.advance(3);
+  EXPECT_EQ("fuu", delivered_);
+  ASSERT_EQ(2u, updates_.size());
+  EXPECT_EQ(OrderStatus::CANCELLED, updates_[1].status);
+  EXPECT_EQ(2, updates_[1].remaining_int);
+  EXPECT_EQ(2u, updates_[1].exec_time);
+}
+
+TEST_F(SimExchangeTest, MarketOrderWalksToNextLevelAfterRemoval) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 5));
+  exchange_.on_tick(quote(1, Side::SELL, PRICE + 500 * STEP, 5));
+  exchange_.on_tick(quote(2, Side::SELL, PRICE, 0));
+  exchange_.submit(Side::BUY, 3, 0, OrderType::MARKET);
+  exchange_.advance(3);
+
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(PRICE + 500 * STEP, fills_[0].price_int);
+  EXPECT_EQ(3, fills_[0].amount_int);
+}
+
+TEST_F(SimExchangeTest, TradesConsumeQueueAheadFirst) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 10));
+  const uint64_t id = exchange_.submit(Side::BUY, 4, PRICE);
+  exchange_.advance(2);
+
+  exchange_.on_tick(trade(3, Trade::Type::ASK, PRICE, 6));
+  EXPECT_TRUE(fills_.empty());
+  exchange_.on_tick(quote(3, Side::BUY, PRICE, 4));
+  exchange_.on_tick(trade(4, Trade::Type::ASK, PRICE, 7));
+
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(id, fills_[0].order_id);
+  EXPECT_EQ(3, fills_[0].amount_int);
+  EXPECT_EQ(1, fills_[0].remaining_int);
+  EXPECT_TRUE(fills_[0].maker);
+}
+
+TEST_F(SimExchangeTest, CancelsAheadMoveUsUpProportionally) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 10));
+  exchange_.submit(Side::BUY, 4, PRICE);
+  exchange_.advance(2);
+
+  // Half the level is cancelled without trades: half the queue ahead goes.
+  exchange_.on_tick(quote(3, Side::BUY, PRICE, 5));
+  exchange_.on_tick(trade(4, Trade::Type::ASK, PRICE, 5));
+  EXPECT_TRUE(fills_.empty());
+  exchange_.on_tick(trade(5, Trade::Type::ASK, PRICE, 1));
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(1, fills_[0].amount_int);
+}
+
+TEST_F(SimExchangeTest, TradeThroughFillsBetterLevelsWithoutQueue) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 10));
+  exchange_.submit(Side::BUY, 2, PRICE + 100 * STEP);
+  exchange_.submit(Side::BUY, 2, PRICE);
+  exchange_.advance(2);
+
+  exchange_.on_tick(trade(3, Trade::Type::ASK, PRICE, 5));
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(PRICE + 100 * STEP, fills_[0].price_int);
+  EXPECT_EQ(2, fills_[0].amount_int);
+  EXPECT_EQ(1u, exchange_.open_orders());
+}
+
+TEST_F(SimExchangeTest, CancelledOrderDoesNotFill) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 1));
+  const uint64_t id = exchange_.submit(Side::BUY, 2, PRICE);
+  exchange_.advance(2);
+  EXPECT_TRUE(exchange_.cancel(id));
+  exchange_.advance(3);
+  EXPECT_EQ(0u, exchange_.open_orders());
+  EXPECT_FALSE(exchange_.cancel(id));
+
+  exchange_.on_tick(trade(4, Trade::Type::ASK, PRICE, 10));
+  EXPECT_TRUE(fills_.empty());
+}
+
+// Trade volume the depth never showed (here more than was displayed) must
+// not be kept and later taken for trades when the level really cancels.
+TEST_F(SimExchangeTest, StaleTradeVolumeDoesNotHideCancels) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 20));
+  exchange_.on_tick(trade(2, Trade::Type::ASK, PRICE, 50));
+  exchange_.on_tick(quote(3, Side::BUY, PRICE, 0));
+  exchange_.on_tick(quote(4, Side::BUY, PRICE, 100));
+  exchange_.submit(Side::BUY, 10, PRICE);
+  exchange_.advance(5);
+
+  // 40 of 200 cancelled: a fifth of the 100 ahead of us goes.
+  exchange_.on_tick(quote(6, Side::BUY, PRICE, 200));
+  exchange_.on_tick(quote(7, Side::BUY, PRICE, 160));
+  exchange_.on_tick(trade(8, Trade::Type::ASK, PRICE, 85));
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(5, fills_[0].amount_int);
+}
+
+TEST_F(SimExchangeTest, RejectsOffLadderOrders) {
+  EXPECT_EQ(0u, exchange_.submit(Side::BUY, 1, PRICE + 1));
+  EXPECT_EQ(0u, exchange_.submit(Side::BUY, 1, -STEP));
+  EXPECT_EQ(0u, exchange_.submit(Side::BUY, 0, PRICE));
+}
+
+TEST_F(SimExchangeTest, BestLevelTracksSparseBook) {
+  std::mt19937 rng(42);
+  // Best first on both sides.
+  std::map<int32_t, int64_t, std::greater<int32_t>> bids;
+  std::map<int32_t, int64_t> asks;
+  uint64_t time = 1;
+  for (int i = 0; i < 20000; ++i, ++time) {
+    // Levels spread over the whole ladder, so the best jumps far. Bids sit
+    // below the asks so the book never crosses.
+    const bool bid = rng() % 2 == 0;
+    const int32_t price = STEP * static_cast<int32_t>(
+        bid ? rng() % 50000 : 50000 + rng() % 50000);
+    const int64_t volume = rng() % 3 == 0 ? 0 : 1 + rng() % 10;
+    exchange_.on_tick(quote(time, bid ? Side::BUY : Side::SELL, price, volume));
+    if (bid && volume > 0) {
+      bids[price] = volume;
+    } else if (bid) {
+      bids.erase(price);
+    } else if (volume > 0) {
+      asks[price] = volume;
+    } else {
+      asks.erase(price);
+    }
+    if (i % 7 == 0 && !bids.empty() && !asks.empty()) {
+      fills_.clear();
+      exchange_.submit(Side::BUY, 1, 0, OrderType::MARKET);
+      exchange_.submit(Side::SELL, 1, 0, OrderType::MARKET);
+      exchange_.advance(time);
+      ASSERT_EQ(2u, fills_.size());
+      ASSERT_EQ(asks.begin()->first, fills_[0].price_int);
+      ASSERT_EQ(bids.begin()->first, fills_[1].price_int);
+      if (--asks.begin()->second == 0) {
+        asks.erase(asks.begin());
+      }
+      if (--bids.begin()->second == 0) {
+        bids.erase(bids.begin());
+      }
+    }
+  }
+}
+
+class SimExchangeLatencyTest : public SimExchangeTest {
+ protected:
+  static SimExchangeConfig config() {
+    SimExchangeConfig config;
+    config.order_latency = 100;
+    config.fill_latency = 10;
+    return config;
+  }
+
+  SimExchangeLatencyTest() : SimExchangeTest(config()) {}
+};
+
+TEST_F(SimExchangeLatencyTest, OrdersAndFillsAreDelayed) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 5));
+  exchange_.submit(Side::BUY, 1, PRICE);
+  exchange_.advance(50);
+  EXPECT_EQ(5, exchange_.visible_volume(Side::SELL, PRICE));
+
+  exchange_.advance(105);
+  EXPECT_EQ(4, exchange_.visible_volume(Side::SELL, PRICE));
+  EXPECT_TRUE(fills_.empty());
+  exchange_.advance(111);
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(101u, fills_[0].exec_time);
+  EXPECT_EQ(111u, fills_[0].time);
+}
+
+// The cancel reaches the book after the order it follows, so a marketable
+// order fills anyway and a resting one is pulled before it can trade.
+TEST_F(SimExchangeLatencyTest, CancelArrivesAfterOrder) {
+  exchange_.on_tick(quote(1, Side::SELL, PRICE, 5));
+  exchange_.on_tick(quote(1, Side::BUY, PRICE - STEP, 5));
+  const uint64_t taker = exchange_.submit(Side::BUY, 1, PRICE);
+  const uint64_t maker = exchange_.submit(Side::BUY, 1, PRICE - STEP);
+  EXPECT_TRUE(exchange_.cancel(taker));
+  EXPECT_TRUE(exchange_.cancel(maker));
+  exchange_.advance(200);
+  ASSERT_EQ(1u, fills_.size());
+  EXPECT_EQ(taker, fills_[0].order_id);
+  EXPECT_EQ(0u, exchange_.open_orders());
+
+  exchange_.on_tick(trade(300, Trade::Type::ASK, PRICE - STEP, 10));
+  exchange_.advance(400);
+  EXPECT_EQ(1u, fills_.size());
+
+  // The taker's cancel found it filled; the maker rested, then was pulled.
+  EXPECT_EQ("fuuu", delivered_);
+  ASSERT_EQ(3u, updates_.size());
+  EXPECT_EQ(maker, updates_[0].order_id);
+  EXPECT_EQ(OrderStatus::ACCEPTED, updates_[0].status);
+  EXPECT_EQ(taker, updates_[1].order_id);
+  EXPECT_EQ(OrderStatus::REJECTED, updates_[1].status);
+  EXPECT_EQ(maker, updates_[2].order_id);
+  EXPECT_EQ(OrderStatus::CANCELLED, updates_[2].status);
+  EXPECT_EQ(1, updates_[2].remaining_int);
+}
+
+// A cancel sent while the order is resting loses the race to a trade that
+// reaches the book first: the fills arrive, then the cancel's answer.
+TEST_F(SimExchangeLatencyTest, CancelRacingFill) {
+  exchange_.on_tick(quote(1, Side::BUY, PRICE, 0));
+  const uint64_t full = exchange_.submit(Side::BUY, 2, PRICE);
+  const uint64_t partial = exchange_.submit(Side::BUY, 5, PRICE);
+  exchange_.advance(150);
+  ASSERT_EQ(2u, updates_.size());
+
+  EXPECT_TRUE(exchange_.cancel(full));
+  EXPECT_TRUE(exchange_.cancel(partial));
+  exchange_.on_tick(trade(200, Trade::Type::ASK, PRICE, 4));
+  exchange_.advance(300);
+
+  EXPECT_EQ("uuffuu", delivered_);
+  ASSERT_EQ(2u, fills_.size());
+  EXPECT_EQ(full, fills_[0].order_id);
+  EXPECT_EQ(0, fills_[0].remaining_int);
+  EXPECT_EQ(partial, fills_[1].order_id);
+  EXPECT_EQ(3, fills_[1].remaining_int);
+  ASSERT_EQ(4u, updates_.size());
+  EXPECT_EQ(full, updates_[2].order_id);
+  EXPECT_EQ(OrderStatus::REJECTED, updates_[2].status);
+  EXPECT_EQ(0, updates_[2].remaining_int);
+  EXPECT_EQ(250u, updates_[2].exec_time);
+  EXPECT_EQ(260u, updates_[2].time);
+  EXPECT_EQ(partial, updates_[3].order_id);
+  EXPECT_EQ(OrderStatus::CANCELLED, updates_[3].status);
+  EXPECT_EQ(3, updates_[3].remaining_int);
+  EXPECT_EQ(0u, exchange_.open_orders());
+}
+
+TEST(SimExchangeDeathTest, RejectsZeroPriceStep) {
+  SimExchangeConfig config;
+  config.price_step = 0;
+  EXPECT_DEATH(SimExchange{config}, "price_step");
+}
+
+}  // anonymous namespace
+}  // namespace btc_arb
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace btc_arb {
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Bounded single-producer / single-consumer ring. Slots are allocated once
+// up front and handed out in place, so element types that own buffers
+// (e.g. std::string) keep their capacity across laps and the steady state
+// does not allocate.
+template<typename T>
+class SpscRing {
+ public:
+  // capacity must be a power of two
+  explicit SpscRing(size_t capacity, const T& prototype = T());
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Producer side: next_slot() returns nullptr when the ring is full; the
+  // slot becomes visible to the consumer on commit().
+  inline T* next_slot();
+  inline void commit();
+
+  // Consumer side: front() returns nullptr when the ring is empty; the slot
+  // is handed back to the producer on pop().
+  inline T* front();
+  inline void pop();
+
+  // Touches every slot so the pages are resident before the hot loop
+  // starts. warm runs on each slot as well, to allocate and touch buffers
+  // the slot owns (e.g. reserve a string), which live outside the ring.
+  template<typename Warm>
+  void prefault(Warm warm);
+  void prefault() { prefault([](T&) {}); }
+
+  size_t capacity() const { return slots_.size(); }
+  // Approximate when read concurrently with either side.
+  size_t size() const {
+    return tail_.load(std::memory_order_relaxed) -
+        head_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Consumer and producer state are padded apart so the two threads do not
+  // false-share a cache line.
+  std::vector<T> slots_;
+  const uint64_t mask_;
+  char pad0_[CACHE_LINE_SIZE];
+  std::atomic<uint64_t> head_{0};  // written by consumer
+  uint64_t cached_tail_ = 0;
+  char pad1_[CACHE_LINE_SIZE];
+  std::atomic<uint64_t> tail_{0};  // written by producer
+  uint64_t cached_head_ = 0;
+  char pad2_[CACHE_LINE_SIZE];
+};
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity, const T& prototype)
+    : slots_(capacity, prototype), mask_(capacity - 1) {
+  CHECK (capacity > 0 && (capacity & mask_) == 0)
+      << "ring capacity must be a power of two, got " << capacity;
+}
+
+template<typename T>
+T* SpscRing<T>::next_slot() {
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail - cached_head_ == slots_.size()) {
+    cached_head_ = head_.load(std::memory_order_acquire);
+    if (tail - cached_head_ == slots_.size()) {
+      return nullptr;
+    }
+  }
+  return &slots_[tail & mask_];
+}
+
+template<typename T>
+void SpscRing<T>::commit() {
+  tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+}
+
+template<typename T>
+T* SpscRing<T>::front() {
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head == cached_tail_) {
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    if (head == cached_tail_) {
+      return nullptr;
+    }
+  }
+  return &slots_[head & mask_];
+}
+
+template<typename T>
+void SpscRing<T>::pop() {
+  head_.store(head_.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+}
+
+template<typename T>
+template<typename Warm>
+void SpscRing<T>::prefault(Warm warm) {
+  volatile char* begin = reinterpret_cast<volatile char*>(slots_.data());
+  const size_t size = slots_.size() * sizeof(T);
+  for (size_t offset = 0; offset < size; offset += 4096) {
+    begin[offset] = begin[offset];
+  }
+  for (T& slot : slots_) {
+    warm(slot);
+  }
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,384 @@
+#include "tick_query.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+namespace {
+struct BarState {
+  int32_t open;
+  int32_t high;
+  int32_t low;
+  int32_t close;
+  int64_t volume;
+  uint32_t trades;
+};
+
+inline uint32_t currency_bit(Currency cyc) {
+  return 1u << static_cast<uint32_t>(cyc);
+}
+
+template<typename Iterator>
+void add_levels(Iterator level, Iterator end, uint32_t depth,
+                google::protobuf::RepeatedPtrField<query::BookLevel>& levels) {
+  for (uint32_t added = 0; added < depth && level != end; ++added, ++level) {
+    query::BookLevel* out = levels.Add();
+    out->set_price_int(level->first);
+    out->set_volume_int(level->second);
+  }
+}
+}  // anonymous namespace
+
+shared_ptr<const query::TickChunk> QueryCache::chunk(const string& key) {
+  lock_guard<mutex> guard(mutex_);
+  auto found = chunk_index_.find(key);
+  if (found == chunk_index_.end()) {
+    return nullptr;
+  }
+  chunks_.splice(chunks_.begin(), chunks_, found->second);
+  return found->second->chunk;
+}
+
+void QueryCache::put_chunk(const string& key,
+                           const shared_ptr<const query::TickChunk>& chunk) {
+  const size_t bytes = key.size() + chunk->ByteSize();
+  if (bytes > max_bytes_) {
+    return;
+  }
+  lock_guard<mutex> guard(mutex_);
+  if (chunk_index_.count(key) > 0) {
+    return;
+  }
+  chunks_.push_front(CachedChunk{key, chunk, bytes});
+  chunk_index_[key] = chunks_.begin();
+  bytes_ += bytes;
+  while (bytes_ > max_bytes_) {
+    bytes_ -= chunks_.back().bytes;
+    chunk_index_.erase(chunks_.back().key);
+    chunks_.pop_back();
+  }
+}
+
+shared_ptr<const BookSet> QueryCache::book(uint64_t& index) {
+  lock_guard<mutex> guard(mutex_);
+  auto after = books_.upper_bound(index);
+  if (after == books_.begin()) {
+    index = 0;
+    return make_shared<const BookSet>();
+  }
+  --after;
+  index = after->first;
+  return after->second;
+}
+
+void QueryCache::put_book(uint64_t index, const shared_ptr<const BookSet>& book) {
+  lock_guard<mutex> guard(mutex_);
+  if (!books_.emplace(index, book).second ||
+      index % checkpoint_ticks_ == 0) {
+    return;
+  }
+  hot_books_.push_back(index);
+  if (hot_books_.size() > MAX_HOT_BOOKS) {
+    books_.erase(hot_books_.front());
+    hot_books_.pop_front();
+  }
+}
+
+TickQueryServer::TickQueryServer(
+    const map<string, vector<string>>& files, const TickQueryConfig& config)
+    : config_(config),
+      requests_(MetricsRegistry::instance().counter(
+          "btc_arb_query_requests_total", "Tick query chunks requested")),
+      cache_hits_(MetricsRegistry::instance().counter(
+          "btc_arb_query_cache_hits_total",
+          "Tick query chunks served from the hot-range cache")),
+      scanned_(MetricsRegistry::instance().counter(
+          "btc_arb_query_ticks_scanned_total",
+          "Ticks scanned answering tick queries")) {
+  for (const auto& venue : files) {
+    venues_[venue.first].reset(new Venue(venue.second, config_));
+    LOG(INFO) << "serving " << venues_[venue.first]->store.size() << " "
+              << venue.first << " ticks from " << venue.second.size()
+              << " files";
+  }
+}
+
+void TickQueryServer::Query(const query::TickQuery& request,
+                            rpcz::reply<query::TickChunk> reply) {
+  string error;
+  shared_ptr<const query::TickChunk> chunk = answer(request, error);
+  if (!chunk) {
+    LOG(WARNING) << "invalid query: " << error;
+    reply.Error(INVALID_QUERY, error);
+    return;
+  }
+  reply.send(*chunk);
+}
+
+shared_ptr<const query::TickChunk> TickQueryServer::answer(
+    const query::TickQuery& request, string& error) {
+  requests_.inc();
+  auto found = venues_.find(request.venue());
+  if (found == venues_.end()) {
+    error = "unknown venue '" + request.venue() + "'";
+    return nullptr;
+  }
+  if (request.start_time() >= request.end_time()) {
+    error = "empty time range";
+    return nullptr;
+  }
+  if (request.result() != query::TICKS && request.interval() == 0) {
+    error = "interval must be positive";
+    return nullptr;
+  }
+  if (request.max_chunk() == 0) {
+    error = "max_chunk must be positive";
+    return nullptr;
+  }
+  uint32_t currencies = request.currencies_size() == 0 ? ~0u : 0;
+  for (const string& name : request.currencies()) {
+    Currency cyc;
+    if (!enum_from_chars(name.data(), name.size(), cyc)) {
+      error = "unknown currency '" + name + "'";
+      return nullptr;
+    }
+    currencies |= currency_bit(cyc);
+  }
+  for (const query::Bar& bar : request.cursor().open_bars()) {
+    Currency cyc;
+    if (!enum_from_chars(bar.currency().data(), bar.currency().size(), cyc)) {
+      error = "invalid cursor";
+      return nullptr;
+    }
+  }
+
+  Venue& venue = *found->second;
+  const string key = request.SerializeAsString();
+  shared_ptr<const query::TickChunk> cached = venue.cache.chunk(key);
+  if (cached) {
+    cache_hits_.inc();
+    return cached;
+  }
+  shared_ptr<query::TickChunk> chunk = make_shared<query::TickChunk>();
+  switch (request.result()) {
+    case query::TICKS:
+      query_ticks(venue, request, currencies, *chunk);
+      break;
+    case query::BARS:
+      query_bars(venue, request, currencies, *chunk);
+      break;
+    case query::BOOKS:
+      query_books(venue, request, currencies, *chunk);
+      break;
+  }
+  venue.cache.put_chunk(key, chunk);
+  return chunk;
+}
+
+void TickQueryServer::query_ticks(const Venue& venue,
+                                  const query::TickQuery& request,
+                                  uint32_t currencies, query::TickChunk& chunk) {
+  const TickStore& store = venue.store;
+  const uint64_t begin = request.has_cursor()
+      ? request.cursor().tick() : store.lower_bound(request.start_time());
+  const uint64_t end = store.lower_bound(request.end_time());
+  Tick::Type type = Tick::Type::EMPTY;  // any
+  if (request.tick_type() == query::QUOTE) {
+    type = Tick::Type::QUOTE;
+  } else if (request.tick_type() == query::TRADE) {
+    type = Tick::Type::TRADE;
+  }
+
+  string& ticks = *chunk.mutable_ticks();
+  uint32_t matched = 0;
+  uint64_t scanned = 0;
+  const uint64_t stopped = store.scan(begin, end, [&](const Tick& tick) {
+    if (matched == request.max_chunk() || scanned == config_.max_scan_ticks) {
+      return false;
+    }
+    ++scanned;
+    if (tick.type == Tick::Type::EMPTY ||
+        (type != Tick::Type::EMPTY && tick.type != type) ||
+        (currencies & currency_bit(tick_currency(tick))) == 0) {
+      return true;
+    }
+    ticks.append(reinterpret_cast<const char*>(&tick), sizeof(Tick));
+    ++matched;
+    return true;
+  });
+  scanned_.inc(scanned);
+  if (stopped < end) {
+    chunk.mutable_cursor()->set_tick(stopped);
+  }
+}
+
+// Bars are aligned to start_time and built from trades only; empty bars are
+// skipped. Full chunks end on bar boundaries, so a chunk may exceed max_chunk
+// by the bars of one interval; a chunk cut short by max_scan_ticks hands the
+// bars still open to the next chunk in its cursor.
+void TickQueryServer::query_bars(const Venue& venue,
+                                 const query::TickQuery& request,
+                                 uint32_t currencies, query::TickChunk& chunk) {
+  const TickStore& store = venue.store;
+  const uint64_t interval = request.interval();
+  const uint64_t begin = request.has_cursor()
+      ? request.cursor().tick() : store.lower_bound(request.start_time());
+  const uint64_t end = store.lower_bound(request.end_time());
+  uint64_t bar_start = request.has_cursor()
+      ? request.cursor().time() : request.start_time();
+
+  BarState bars[enum_size<Currency>()] = {};
+  for (const query::Bar& bar : request.cursor().open_bars()) {
+    Currency cyc;
+    enum_from_chars(bar.currency().data(), bar.currency().size(), cyc);
+    bars[static_cast<size_t>(cyc)] = BarState{
+      bar.open_int(), bar.high_int(), bar.low_int(), bar.close_int(),
+      bar.volume_int(), bar.trades()};
+  }
+  auto write_bars = [&](google::protobuf::RepeatedPtrField<query::Bar>& out) {
+    for (size_t cyc = 0; cyc < enum_size<Currency>(); ++cyc) {
+      BarState& state = bars[cyc];
+      if (state.trades == 0) {
+        continue;
+      }
+      query::Bar* bar = out.Add();
+      bar->set_currency(enum_name(static_cast<Currency>(cyc)));
+      bar->set_start_time(bar_start);
+      bar->set_open_int(state.open);
+      bar->set_high_int(state.high);
+      bar->set_low_int(state.low);
+      bar->set_close_int(state.close);
+      bar->set_volume_int(state.volume);
+      bar->set_trades(state.trades);
+      state = BarState{};
+    }
+  };
+
+  uint64_t scanned = 0;
+  const uint64_t stopped = store.scan(begin, end, [&](const Tick& tick) {
+    if (scanned == config_.max_scan_ticks) {
+      return false;
+    }
+    const uint64_t received = tick_received(tick);
+    if (received >= bar_start + interval) {
+      write_bars(*chunk.mutable_bars());
+      bar_start += (received - bar_start) / interval * interval;
+      if (static_cast<uint32_t>(chunk.bars_size()) >= request.max_chunk()) {
+        return false;
+      }
+    }
+    ++scanned;
+    if (tick.type != Tick::Type::TRADE ||
+        (currencies & currency_bit(tick_currency(tick))) == 0) {
+      return true;
+    }
+    const Trade& trade = tick.as<Trade>();
+    BarState& state = bars[static_cast<size_t>(trade.cyc)];
+    if (state.trades == 0) {
+      state.open = state.high = state.low = trade.price_int;
+    }
+    state.high = max(state.high, trade.price_int);
+    state.low = min(state.low, trade.price_int);
+    state.close = trade.price_int;
+    state.volume += trade.amount_int;
+    ++state.trades;
+    return true;
+  });
+  scanned_.inc(scanned);
+  if (stopped < end) {
+    chunk.mutable_cursor()->set_tick(stopped);
+    chunk.mutable_cursor()->set_time(bar_start);
+    write_bars(*chunk.mutable_cursor()->mutable_open_bars());
+  } else {
+    write_bars(*chunk.mutable_bars());
+  }
+}
+
+// Samples every interval from start_time; a book sampled at t has all
+// quotes received up to t applied. Currencies with an empty book are
+// skipped. Sampling stops at the last stored tick, after which the books
+// cannot change, so an open-ended end_time still ends the query.
+void TickQueryServer::query_books(Venue& venue, const query::TickQuery& request,
+                                  uint32_t currencies, query::TickChunk& chunk) {
+  const TickStore& store = venue.store;
+  const uint64_t interval = request.interval();
+  const uint64_t begin = request.has_cursor()
+      ? request.cursor().tick() : store.lower_bound(request.start_time());
+  const uint64_t end = store.lower_bound(request.end_time());
+  uint64_t sample = request.has_cursor()
+      ? request.cursor().time() : request.start_time();
+  const uint64_t sample_end = end < store.size() ? request.end_time()
+      : min(request.end_time(), store.last_received() + 1);
+
+  // Catch up from the latest saved state, saving checkpoints on the way.
+  uint64_t at = begin;
+  shared_ptr<BookSet> books = make_shared<BookSet>(*venue.cache.book(at));
+
+  auto take_sample = [&]() {
+    for (size_t cyc = 0; cyc < enum_size<Currency>(); ++cyc) {
+      const BookSet::Side& bids = books->bids[cyc];
+      const BookSet::Side& asks = books->asks[cyc];
+      if ((currencies & (1u << cyc)) == 0 || (bids.empty() && asks.empty())) {
+        continue;
+      }
+      query::Book* book = chunk.add_books();
+      book->set_currency(enum_name(static_cast<Currency>(cyc)));
+      book->set_time(sample);
+      add_levels(bids.rbegin(), bids.rend(), request.book_depth(),
+                 *book->mutable_bids());
+      add_levels(asks.begin(), asks.end(), request.book_depth(),
+                 *book->mutable_asks());
+    }
+    sample += interval;
+  };
+  auto chunk_full = [&]() {
+    return static_cast<uint32_t>(chunk.books_size()) >= request.max_chunk();
+  };
+
+  uint64_t scanned = 0;
+  const uint64_t stopped = store.scan(at, end, [&](const Tick& tick) {
+    // Also ends a long catch-up; the next chunk resumes from the state saved
+    // here and takes no samples until it reaches start_time.
+    if (scanned == config_.max_scan_ticks) {
+      return false;
+    }
+    if (at >= begin) {
+      const uint64_t received = tick_received(tick);
+      while (sample < received && sample < request.end_time()) {
+        if (chunk_full()) {
+          return false;
+        }
+        take_sample();
+      }
+    }
+    ++scanned;
+    if (tick.type == Tick::Type::QUOTE) {
+      books->apply(tick.as<Quote>());
+    }
+    if (++at % config_.book_checkpoint_ticks == 0) {
+      venue.cache.put_book(at, make_shared<const BookSet>(*books));
+    }
+    return true;
+  });
+  scanned_.inc(scanned);
+  if (stopped == end) {
+    while (sample < sample_end && !chunk_full()) {
+      take_sample();
+    }
+    if (sample >= sample_end) {
+      return;
+    }
+  }
+  chunk.mutable_cursor()->set_tick(stopped);
+  chunk.mutable_cursor()->set_time(sample);
+  venue.cache.put_book(stopped, books);
+}
+
+}  // namespace btc_arb
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "book_set.hpp"
+#include "ticker_plant.hpp"
+#include "metrics.hpp"
+#include "tick_store.hpp"
+#include "tick_query.pb.h"
+#include "tick_query.rpcz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Book states kept where chunks ended, for the next chunk to resume from.
+constexpr size_t MAX_HOT_BOOKS = 256;
+constexpr size_t DEFAULT_QUERY_CACHE_BYTES = 256 << 20;
+
+struct TickQueryConfig {
+  size_t cache_bytes = DEFAULT_QUERY_CACHE_BYTES;  // per venue
+  // Most ticks scanned for one chunk of any result, including the replay a
+  // book query starts with, so a sparse filter or a far start over a long
+  // range cannot hold a worker thread while other clients wait.
+  uint64_t max_scan_ticks = 1 << 22;
+  // Book states are kept every this many ticks once a scan has passed them.
+  uint64_t book_checkpoint_ticks = 1 << 20;
+};
+
+// Application error sent back for malformed queries.
+constexpr int INVALID_QUERY = 1;
+
+// Hot-range cache of one venue: recently served chunks keyed by their
+// serialized query, so pages re-read by several clients or a refreshing
+// dashboard are not rescanned, and book states at checkpoints and where
+// chunks ended, so book queries do not replay the file from the start.
+class QueryCache {
+ public:
+  QueryCache(size_t max_bytes, uint64_t checkpoint_ticks)
+      : max_bytes_(max_bytes), checkpoint_ticks_(checkpoint_ticks) {}
+  QueryCache(const QueryCache&) = delete;
+
+  std::shared_ptr<const query::TickChunk> chunk(const std::string& key);
+  void put_chunk(const std::string& key,
+                 const std::shared_ptr<const query::TickChunk>& chunk);
+
+  // Latest book state saved at or before tick index, i.e. with the ticks
+  // before it applied; index is moved back to where it was saved. Empty books
+  // at 0 if there is none.
+  std::shared_ptr<const BookSet> book(uint64_t& index);
+  void put_book(uint64_t index, const std::shared_ptr<const BookSet>& book);
+
+ private:
+  struct CachedChunk {
+    std::string key;
+    std::shared_ptr<const query::TickChunk> chunk;
+    size_t bytes;
+  };
+  using ChunkList = std::list<CachedChunk>;
+
+  const size_t max_bytes_;
+  const uint64_t checkpoint_ticks_;
+  std::mutex mutex_;
+  ChunkList chunks_;  // most recently used first
+  std::unordered_map<std::string, ChunkList::iterator> chunk_index_;
+  size_t bytes_ = 0;
+  std::map<uint64_t, std::shared_ptr<const BookSet>> books_;
+  std::list<uint64_t> hot_books_;  // chunk ends, oldest first
+};
+
+// Serves range queries over the stored tick files of each venue, filtering
+// and aggregating on the server and returning at most max_chunk records per
+// call. Calls are independent and hold no per-client state, so any number of
+// clients page through results concurrently, each chunk bounded in work.
+class TickQueryServer : public query::TickQueryService {
+ public:
+  // files maps a venue name to its flat tick files, oldest first.
+  TickQueryServer(const std::map<std::string, std::vector<std::string>>& files,
+                  const TickQueryConfig& config = TickQueryConfig{});
+  TickQueryServer(const TickQueryServer&) = delete;
+
+  virtual void Query(const query::TickQuery& request,
+                     rpcz::reply<query::TickChunk> reply) override;
+
+  // Answers one chunk in-process; returns null and sets error if the query
+  // is invalid.
+  std::shared_ptr<const query::TickChunk> answer(const query::TickQuery& request,
+                                                 std::string& error);
+
+ private:
+  struct Venue {
+    Venue(const std::vector<std::string>& files, const TickQueryConfig& config)
+        : store(files),
+          cache(config.cache_bytes, config.book_checkpoint_ticks) {}
+    TickStore store;
+    QueryCache cache;
+  };
+
+  void query_ticks(const Venue& venue, const query::TickQuery& request,
+                   uint32_t currencies, query::TickChunk& chunk);
+  void query_bars(const Venue& venue, const query::TickQuery& request,
+                  uint32_t currencies, query::TickChunk& chunk);
+  void query_books(Venue& venue, const query::TickQuery& request,
+                   uint32_t currencies, query::TickChunk& chunk);
+
+  const TickQueryConfig config_;
+  std::map<std::string, std::unique_ptr<Venue>> venues_;
+  Counter& requests_;
+  Counter& cache_hits_;
+  Counter& scanned_;
+};
+
+}  // namespace btc_arb
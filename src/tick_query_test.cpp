@@ -0,0 +1,378 @@
+#include "tick_query.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace btc_arb {
+namespace {
+
+constexpr uint64_t T0 = 1370000000000000000;
+constexpr uint64_t INTERVAL = 10000;
+constexpr uint64_t NUM_TICKS = 20000;
+
+// Quotes and trades on USD and EUR around a random-walk price, 0-3 us
+// apart, so several ticks share a receive time.
+std::vector<Tick> random_ticks(uint64_t num_ticks) {
+  std::mt19937 rng(3);
+  std::vector<Tick> ticks;
+  int32_t price = 10000000;
+  uint64_t received = T0;
+  for (uint64_t i = 0; i < num_ticks; ++i) {
+    received += 1000 * (rng() % 4);
+    price += static_cast<int32_t>(rng() % 3) - 1;
+    const Currency cyc = rng() % 3 == 0 ? Currency::EUR : Currency::USD;
+    if (rng() % 5 == 0) {
+      Trade trade{};
+      trade.received = received;
+      trade.type = rng() % 2 ? Trade::Type::BID : Trade::Type::ASK;
+      trade.amount_int = 1 + rng() % 1000;
+      trade.cyc = cyc;
+      trade.price_int = price;
+      ticks.push_back(Tick(trade));
+    } else {
+      const bool bid = rng() % 2;
+      Quote quote{};
+      quote.received = received;
+      quote.type = bid ? Quote::Type::BID_UPDATE : Quote::Type::ASK_UPDATE;
+      quote.total_volume_int = rng() % 4 == 0 ? 0 : 1 + rng() % 1000;
+      quote.cyc = cyc;
+      quote.price_int = bid ? price - 1 - rng() % 20 : price + 1 + rng() % 20;
+      ticks.push_back(Tick(quote));
+    }
+  }
+  return ticks;
+}
+
+std::string serialized(const google::protobuf::RepeatedPtrField<query::Bar>& bars) {
+  std::string out;
+  for (const query::Bar& bar : bars) {
+    out += bar.SerializeAsString();
+  }
+  return out;
+}
+
+std::string serialized(const google::protobuf::RepeatedPtrField<query::Book>& books) {
+  std::string out;
+  for (const query::Book& book : books) {
+    out += book.SerializeAsString();
+  }
+  return out;
+}
+
+// Stores the ticks in three flat files, so scans cross segments.
+class TickQueryTest : public ::testing::Test {
+ protected:
+  TickQueryTest() : ticks_(random_ticks(NUM_TICKS)) {
+    const size_t per_file = ticks_.size() / 3 + 1;
+    for (size_t begin = 0; begin < ticks_.size(); begin += per_file) {
+      char name[] = "/tmp/tick_query_test.XXXXXX";
+      const int fd = mkstemp(name);
+      EXPECT_GE(fd, 0);
+      close(fd);
+      std::ofstream out(name, std::ios::out | std::ios::binary | std::ios::trunc);
+      const size_t size = std::min(per_file, ticks_.size() - begin);
+      out.write(reinterpret_cast<const char*>(&ticks_[begin]),
+                size * sizeof(Tick));
+      paths_.push_back(name);
+    }
+  }
+
+  ~TickQueryTest() {
+    for (const std::string& path : paths_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  std::unique_ptr<TickQueryServer> server(const TickQueryConfig& config) {
+    std::map<std::string, std::vector<std::string>> files;
+    files["test"] = paths_;
+    return std::unique_ptr<TickQueryServer>(new TickQueryServer(files, config));
+  }
+
+  static query::TickQuery request(query::ResultType result, uint64_t start,
+                                  uint64_t end, uint32_t max_chunk) {
+    query::TickQuery request;
+    request.set_venue("test");
+    request.set_start_time(start);
+    request.set_end_time(end);
+    request.set_result(result);
+    request.set_interval(INTERVAL);
+    request.set_book_depth(3);
+    request.set_max_chunk(max_chunk);
+    return request;
+  }
+
+  // Follows the cursor to the last chunk and concatenates the results.
+  static query::TickChunk page(TickQueryServer& server,
+                               query::TickQuery request, size_t* pages) {
+    query::TickChunk all;
+    *pages = 0;
+    while (true) {
+      std::string error;
+      std::shared_ptr<const query::TickChunk> chunk =
+          server.answer(request, error);
+      EXPECT_TRUE(chunk) << error;
+      if (!chunk) {
+        return all;
+      }
+      ++*pages;
+      all.mutable_ticks()->append(chunk->ticks());
+      all.mutable_bars()->MergeFrom(chunk->bars());
+      all.mutable_books()->MergeFrom(chunk->books());
+      if (!chunk->has_cursor()) {
+        return all;
+      }
+      *request.mutable_cursor() = chunk->cursor();
+    }
+  }
+
+  // One chunk with no limit in reach, from a server of its own.
+  query::TickChunk unbounded(query::TickQuery request) {
+    request.set_max_chunk(1u << 30);
+    size_t pages;
+    query::TickChunk all = page(*server(TickQueryConfig{}), request, &pages);
+    EXPECT_EQ(1u, pages);
+    return all;
+  }
+
+  // Small chunks, scan limit and checkpoint spacing, so every query
+  // resumes across all three.
+  static TickQueryConfig small_config() {
+    TickQueryConfig config;
+    config.max_scan_ticks = 700;
+    config.book_checkpoint_ticks = 256;
+    return config;
+  }
+
+  uint64_t last_received() const {
+    return tick_received(ticks_.back());
+  }
+
+  std::vector<Tick> ticks_;
+  std::vector<std::string> paths_;
+};
+
+TEST_F(TickQueryTest, TickPagesMatchOneScan) {
+  const uint64_t start = T0 + 1234567;
+  const uint64_t end = last_received() - 2345678;
+  query::TickQuery request = this->request(query::TICKS, start, end, 37);
+  request.add_currencies("eur");
+  request.set_tick_type(query::QUOTE);
+
+  std::string expected;
+  for (const Tick& tick : ticks_) {
+    if (tick.type == Tick::Type::QUOTE && tick.as<Quote>().cyc == Currency::EUR &&
+        tick_received(tick) >= start && tick_received(tick) < end) {
+      expected.append(reinterpret_cast<const char*>(&tick), sizeof(Tick));
+    }
+  }
+  ASSERT_FALSE(expected.empty());
+  EXPECT_EQ(expected, unbounded(request).ticks());
+
+  size_t pages;
+  const query::TickChunk paged = page(*server(small_config()), request, &pages);
+  EXPECT_EQ(expected, paged.ticks());
+  EXPECT_GT(pages, expected.size() / sizeof(Tick) / 37);
+}
+
+TEST_F(TickQueryTest, BarsAreAlignedToStartTime) {
+  const uint64_t start = T0 + 1234;
+  const uint64_t end = last_received() + 1;
+  query::TickQuery request = this->request(query::BARS, start, end, 5);
+
+  // (bar start, currency) -> open, high, low, close, volume, trades
+  std::map<std::pair<uint64_t, int>,
+           std::tuple<int32_t, int32_t, int32_t, int32_t, int64_t, uint32_t>> bars;
+  for (const Tick& tick : ticks_) {
+    if (tick.type != Tick::Type::TRADE || tick_received(tick) < start) {
+      continue;
+    }
+    const Trade& trade = tick.as<Trade>();
+    const uint64_t bar_start =
+        start + (trade.received - start) / INTERVAL * INTERVAL;
+    auto found = bars.find(std::make_pair(bar_start, static_cast<int>(trade.cyc)));
+    if (found == bars.end()) {
+      bars[std::make_pair(bar_start, static_cast<int>(trade.cyc))] =
+          std::make_tuple(trade.price_int, trade.price_int, trade.price_int,
+                          trade.price_int, trade.amount_int, 1u);
+      continue;
+    }
+    auto& bar = found->second;
+    std::get<1>(bar) = std::max(std::get<1>(bar), trade.price_int);
+    std::get<2>(bar) = std::min(std::get<2>(bar), trade.price_int);
+    std::get<3>(bar) = trade.price_int;
+    std::get<4>(bar) += trade.amount_int;
+    ++std::get<5>(bar);
+  }
+  google::protobuf::RepeatedPtrField<query::Bar> expected;
+  for (const auto& entry : bars) {
+    query::Bar* bar = expected.Add();
+    bar->set_currency(enum_name(static_cast<Currency>(entry.first.second)));
+    bar->set_start_time(entry.first.first);
+    bar->set_open_int(std::get<0>(entry.second));
+    bar->set_high_int(std::get<1>(entry.second));
+    bar->set_low_int(std::get<2>(entry.second));
+    bar->set_close_int(std::get<3>(entry.second));
+    bar->set_volume_int(std::get<4>(entry.second));
+    bar->set_trades(std::get<5>(entry.second));
+  }
+  ASSERT_GT(expected.size(), 100);
+  EXPECT_EQ(serialized(expected), serialized(unbounded(request).bars()));
+
+  size_t pages;
+  const query::TickChunk paged = page(*server(small_config()), request, &pages);
+  EXPECT_EQ(serialized(expected), serialized(paged.bars()));
+  EXPECT_GT(pages, static_cast<size_t>(expected.size() / 5 / 2));
+
+  // Chunks too large to fill end at the scan limit, inside a bar.
+  request.set_max_chunk(1000);
+  const query::TickChunk scan_limited =
+      page(*server(small_config()), request, &pages);
+  EXPECT_EQ(serialized(expected), serialized(scan_limited.bars()));
+  EXPECT_GE(pages, NUM_TICKS / small_config().max_scan_ticks);
+}
+
+TEST_F(TickQueryTest, BookPagesMatchReplay) {
+  // Starts deep into the data, so the first chunk catches up over several
+  // scan limits, and ends past the last tick.
+  const uint64_t start = tick_received(ticks_[ticks_.size() / 2]) + 500;
+  const uint64_t end = last_received() + 10 * INTERVAL;
+  query::TickQuery request = this->request(query::BOOKS, start, end, 4);
+  request.add_currencies("usd");
+
+  google::protobuf::RepeatedPtrField<query::Book> expected;
+  BookSet books;
+  size_t next = 0;
+  for (uint64_t sample = start; sample <= last_received(); sample += INTERVAL) {
+    for (; next < ticks_.size() && tick_received(ticks_[next]) <= sample; ++next) {
+      if (ticks_[next].type == Tick::Type::QUOTE) {
+        books.apply(ticks_[next].as<Quote>());
+      }
+    }
+    const BookSet::Side& bids = books.bids[static_cast<size_t>(Currency::USD)];
+    const BookSet::Side& asks = books.asks[static_cast<size_t>(Currency::USD)];
+    if (bids.empty() && asks.empty()) {
+      continue;
+    }
+    query::Book* book = expected.Add();
+    book->set_currency("usd");
+    book->set_time(sample);
+    auto bid = bids.rbegin();
+    for (int level = 0; level < 3 && bid != bids.rend(); ++level, ++bid) {
+      query::BookLevel* out = book->add_bids();
+      out->set_price_int(bid->first);
+      out->set_volume_int(bid->second);
+    }
+    auto ask = asks.begin();
+    for (int level = 0; level < 3 && ask != asks.end(); ++level, ++ask) {
+      query::BookLevel* out = book->add_asks();
+      out->set_price_int(ask->first);
+      out->set_volume_int(ask->second);
+    }
+  }
+  ASSERT_GT(expected.size(), 100);
+  EXPECT_EQ(serialized(expected), serialized(unbounded(request).books()));
+
+  // The second run starts from the checkpoints the first one left.
+  std::unique_ptr<TickQueryServer> paging = server(small_config());
+  for (int run = 0; run < 2; ++run) {
+    size_t pages;
+    const query::TickChunk paged = page(*paging, request, &pages);
+    EXPECT_EQ(serialized(expected), serialized(paged.books())) << "run " << run;
+    EXPECT_GT(pages, static_cast<size_t>(expected.size() / 4));
+  }
+  request.set_start_time(start + 3 * INTERVAL);
+  request.set_max_chunk(1u << 30);
+  size_t pages;
+  const query::TickChunk later = page(*paging, request, &pages);
+  ASSERT_EQ(expected.size() - 3, later.books_size());
+  EXPECT_EQ(expected.Get(3).SerializeAsString(),
+            later.books(0).SerializeAsString());
+}
+
+TEST_F(TickQueryTest, RepeatedChunkComesFromCache) {
+  std::unique_ptr<TickQueryServer> paging = server(small_config());
+  const query::TickQuery request =
+      this->request(query::TICKS, T0, last_received() + 1, 10);
+  std::string error;
+  std::shared_ptr<const query::TickChunk> first = paging->answer(request, error);
+  std::shared_ptr<const query::TickChunk> second = paging->answer(request, error);
+  ASSERT_TRUE(first);
+  EXPECT_EQ(first, second);
+}
+
+TEST(QueryCacheTest, EvictsLeastRecentlyUsedChunks) {
+  std::shared_ptr<query::TickChunk> chunk = std::make_shared<query::TickChunk>();
+  chunk->set_ticks(std::string(100, 'x'));
+  const size_t bytes = 1 + chunk->ByteSize();
+  QueryCache cache(3 * bytes, 16);
+  cache.put_chunk("a", chunk);
+  cache.put_chunk("b", chunk);
+  cache.put_chunk("c", chunk);
+  EXPECT_TRUE(cache.chunk("a"));  // now most recent
+  cache.put_chunk("d", chunk);
+  EXPECT_TRUE(cache.chunk("a"));
+  EXPECT_FALSE(cache.chunk("b"));
+  EXPECT_TRUE(cache.chunk("c"));
+  EXPECT_TRUE(cache.chunk("d"));
+
+  // Too large to keep at all.
+  QueryCache small(bytes - 1, 16);
+  small.put_chunk("a", chunk);
+  EXPECT_FALSE(small.chunk("a"));
+}
+
+TEST(QueryCacheTest, BookIsLatestAtOrBeforeIndex) {
+  QueryCache cache(1 << 20, 16);
+  uint64_t index = 100;
+  std::shared_ptr<const BookSet> book = cache.book(index);
+  EXPECT_EQ(0u, index);
+  ASSERT_TRUE(book);
+  EXPECT_TRUE(book->bids[0].empty());
+
+  std::shared_ptr<const BookSet> at_32 = std::make_shared<const BookSet>();
+  std::shared_ptr<const BookSet> at_50 = std::make_shared<const BookSet>();
+  cache.put_book(32, at_32);
+  cache.put_book(50, at_50);
+  index = 49;
+  EXPECT_EQ(at_32, cache.book(index));
+  EXPECT_EQ(32u, index);
+  index = 50;
+  EXPECT_EQ(at_50, cache.book(index));
+  EXPECT_EQ(50u, index);
+  index = 1000;
+  EXPECT_EQ(at_50, cache.book(index));
+  EXPECT_EQ(50u, index);
+}
+
+// Chunk ends are dropped oldest first; checkpoints are kept for good.
+TEST(QueryCacheTest, KeepsCheckpointsOverHotBooks) {
+  QueryCache cache(1 << 20, 16);
+  std::shared_ptr<const BookSet> checkpoint = std::make_shared<const BookSet>();
+  cache.put_book(16, checkpoint);
+  for (uint64_t i = 0; i < MAX_HOT_BOOKS + 1; ++i) {
+    cache.put_book(1000 + 2 * i + 1, std::make_shared<const BookSet>());
+  }
+  uint64_t index = 1002;
+  cache.book(index);
+  EXPECT_EQ(16u, index);  // 1001 was dropped
+  index = 1003;
+  cache.book(index);
+  EXPECT_EQ(1003u, index);
+  index = 17;
+  EXPECT_EQ(checkpoint, cache.book(index));
+}
+
+}  // anonymous namespace
+}  // namespace btc_arb
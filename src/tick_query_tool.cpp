@@ -0,0 +1,286 @@
+#include "tick_query.hpp"
+#include "metrics.hpp"
+
+#include <boost/program_options.hpp>
+#include <glog/logging.h>
+#include <rpcz/rpcz.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+using namespace btc_arb;
+
+namespace {
+constexpr long QUERY_DEADLINE_MS = 60000;
+
+string to_upper(string str) {
+  transform(str.begin(), str.end(), str.begin(), ::toupper);
+  return str;
+}
+
+struct FetchStats {
+  uint64_t chunks = 0;
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+};
+
+void print_chunk(const query::TickChunk& chunk) {
+  for (const query::Bar& bar : chunk.bars()) {
+    cout << bar.start_time() << " " << bar.currency() << " "
+         << bar.open_int() << " " << bar.high_int() << " " << bar.low_int()
+         << " " << bar.close_int() << " " << bar.volume_int() << " "
+         << bar.trades() << "\n";
+  }
+  for (const query::Book& book : chunk.books()) {
+    cout << book.time() << " " << book.currency();
+    for (const query::BookLevel& level : book.bids()) {
+      cout << " b" << level.price_int() << ":" << level.volume_int();
+    }
+    for (const query::BookLevel& level : book.asks()) {
+      cout << " a" << level.price_int() << ":" << level.volume_int();
+    }
+    cout << "\n";
+  }
+}
+
+// Pages through the whole result of request. Ticks are appended to out if
+// it is open, bars and books printed if print is set.
+FetchStats fetch(rpcz::application& application, const string& endpoint,
+                 query::TickQuery request, ofstream* out, bool print) {
+  query::TickQueryService_Stub stub(
+      application.create_rpc_channel(endpoint), true);
+  FetchStats stats;
+  while (true) {
+    query::TickChunk chunk;
+    stub.Query(request, &chunk, QUERY_DEADLINE_MS);
+    ++stats.chunks;
+    stats.records += chunk.ticks().size() / sizeof(Tick) +
+        chunk.bars_size() + chunk.books_size();
+    stats.bytes += chunk.ByteSize();
+    if (out != nullptr) {
+      out->write(chunk.ticks().data(), chunk.ticks().size());
+    }
+    if (print) {
+      print_chunk(chunk);
+    }
+    if (!chunk.has_cursor()) {
+      return stats;
+    }
+    *request.mutable_cursor() = chunk.cursor();
+  }
+}
+
+void serve(const vector<string>& data, const string& endpoint, int threads,
+           size_t cache_mb, uint16_t metrics_port) {
+  map<string, vector<string>> files;
+  for (const string& venue_path : data) {
+    const string::size_type delim = venue_path.find(':');
+    if (delim == string::npos) {
+      throw runtime_error("invalid data path '" + venue_path + "'");
+    }
+    files[venue_path.substr(0, delim)].push_back(venue_path.substr(delim + 1));
+  }
+  unique_ptr<MetricsServer> metrics_server;
+  if (metrics_port != 0) {
+    metrics_server.reset(new MetricsServer(metrics_port));
+  }
+  TickQueryConfig config;
+  config.cache_bytes = cache_mb << 20;
+  TickQueryServer service{files, config};
+
+  rpcz::application::options options;
+  options.connection_manager_threads = threads;
+  rpcz::application application{options};
+  rpcz::server server{application};
+  server.register_service(&service);
+  server.bind(endpoint);
+  LOG(INFO) << "serving tick queries on " << endpoint << " with " << threads
+            << " threads";
+  application.run();
+}
+
+// With several clients, each fetches the same query in full and only the
+// throughput is reported, to check clients are served evenly.
+void run_query(const string& endpoint, const query::TickQuery& request,
+               const string& out_path, int clients) {
+  rpcz::application application;
+  if (clients <= 1) {
+    ofstream out;
+    if (!out_path.empty()) {
+      out.open(out_path, ios::out | ios::binary | ios::trunc);
+      CHECK (out.is_open()) << "could not open " << out_path;
+    }
+    const FetchStats stats = fetch(application, endpoint, request,
+                                   out.is_open() ? &out : nullptr, true);
+    LOG(INFO) << stats.records << " records in " << stats.chunks << " chunks";
+    return;
+  }
+
+  vector<FetchStats> stats(clients);
+  vector<double> seconds(clients);
+  vector<thread> threads;
+  for (int client = 0; client < clients; ++client) {
+    threads.emplace_back([&, client]() {
+        const auto start = chrono::steady_clock::now();
+        stats[client] = fetch(application, endpoint, request, nullptr, false);
+        seconds[client] = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+      });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int client = 0; client < clients; ++client) {
+    LOG(INFO) << "client " << client << ": " << stats[client].records
+              << " records in " << stats[client].chunks << " chunks, "
+              << seconds[client] << "s, "
+              << stats[client].bytes / seconds[client] / 1E6 << " MB/s";
+  }
+}
+}  // anonymous namespace
+
+int main(int argc, char **argv) {
+  namespace po = boost::program_options;
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+
+  string endpoint{"tcp://*:5557"};
+  int threads{4};
+  size_t cache_mb{DEFAULT_QUERY_CACHE_BYTES >> 20};
+  uint16_t metrics_port{0};
+  string connect;
+  string venue;
+  uint64_t start_time{0};
+  uint64_t end_time{std::numeric_limits<uint64_t>::max()};
+  vector<string> currencies;
+  string tick_type{"any_tick"};
+  string result{"ticks"};
+  query::TickQuery request;
+  uint64_t interval{request.interval()};
+  uint32_t book_depth{request.book_depth()};
+  uint32_t max_chunk{request.max_chunk()};
+  string out_path;
+  int clients{1};
+
+  stringstream desc_msg;
+  desc_msg << "Tick Query -- serves range queries over stored flat tick files, "
+           << "or runs them against a server" << endl << endl
+           << "usage: " << argv[0] << " --data VENUE:PATH... [--bind ENDPOINT]"
+           << endl
+           << "       " << argv[0] << " --connect ENDPOINT --venue VENUE [QUERY]"
+           << endl << endl << "Allowed options:";
+
+  auto description = po::options_description{desc_msg.str()};
+  description.add_options()
+      ("help,h", "prints this help message")
+      ("data",
+       po::value<vector<string>>()->value_name("VENUE:PATH"),
+       "serves a flat tick file for VENUE; repeat in time order for more files")
+      ("bind",
+       po::value<string>(&endpoint)->value_name("ENDPOINT"),
+       ("endpoint to serve on; default=" + endpoint).c_str())
+      ("threads",
+       po::value<int>(&threads)->value_name("N"),
+       "worker threads answering queries")
+      ("cache-mb",
+       po::value<size_t>(&cache_mb)->value_name("MB"),
+       "hot-range cache size per venue")
+      ("metrics-port",
+       po::value<uint16_t>(&metrics_port)->value_name("PORT"),
+       "serves Prometheus metrics on http://127.0.0.1:PORT; 0 disables")
+      ("connect",
+       po::value<string>(&connect)->value_name("ENDPOINT"),
+       "runs a query against the server at ENDPOINT")
+      ("venue", po::value<string>(&venue)->value_name("NAME"), "venue to query")
+      ("start", po::value<uint64_t>(&start_time)->value_name("NS"),
+       "receive time to start from, ns since the epoch")
+      ("end", po::value<uint64_t>(&end_time)->value_name("NS"),
+       "receive time to stop at (exclusive), ns since the epoch")
+      ("currency",
+       po::value<vector<string>>(&currencies)->value_name("CYC"),
+       "currency to keep, e.g. usd; repeat for more; default all")
+      ("tick-type",
+       po::value<string>(&tick_type)->value_name("TYPE"),
+       "any_tick, quote or trade; ticks only")
+      ("result",
+       po::value<string>(&result)->value_name("TYPE"),
+       "ticks, bars or books; default=ticks")
+      ("interval",
+       po::value<uint64_t>(&interval)->value_name("NS"),
+       "bar width or book sampling period")
+      ("book-depth",
+       po::value<uint32_t>(&book_depth)->value_name("N"),
+       "levels per side in sampled books")
+      ("max-chunk",
+       po::value<uint32_t>(&max_chunk)->value_name("N"),
+       "most records per response")
+      ("out",
+       po::value<string>(&out_path)->value_name("PATH"),
+       "writes queried ticks to PATH as a flat file")
+      ("clients",
+       po::value<int>(&clients)->value_name("N"),
+       "runs the query from N concurrent clients and reports throughput");
+
+  auto variables = po::variables_map{};
+  try {
+    po::store(po::parse_command_line(argc, argv, description), variables);
+    po::notify(variables);
+    if (variables.count("help") ||
+        (variables.count("data") == 0 && connect.empty())) {
+      cerr << description << endl;
+      return 0;
+    }
+
+    if (variables.count("data")) {
+      serve(variables["data"].as<vector<string>>(), endpoint, threads,
+            cache_mb, metrics_port);
+      return 0;
+    }
+
+    query::TickType type;
+    query::ResultType result_type;
+    if (!query::TickType_Parse(to_upper(tick_type), &type)) {
+      throw runtime_error("invalid tick type '" + tick_type + "'");
+    }
+    if (!query::ResultType_Parse(to_upper(result), &result_type)) {
+      throw runtime_error("invalid result '" + result + "'");
+    }
+    request.set_venue(venue);
+    request.set_start_time(start_time);
+    request.set_end_time(end_time);
+    for (const string& cyc : currencies) {
+      request.add_currencies(cyc);
+    }
+    request.set_tick_type(type);
+    request.set_result(result_type);
+    request.set_interval(interval);
+    request.set_book_depth(book_depth);
+    request.set_max_chunk(max_chunk);
+    run_query(connect, request, out_path, clients);
+  } catch (const rpcz::rpc_error& e) {
+    LOG(ERROR) << "query failed: " << e.what();
+    return 3;
+  } catch (const boost::program_options::unknown_option& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  } catch (const boost::program_options::invalid_option_value& e) {
+    LOG(ERROR) << e.what();
+    return 2;
+  } catch(const std::exception& e) {
+    LOG(ERROR) << e.what();
+    return -1;
+  }
+  return 0;
+}
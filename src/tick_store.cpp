@@ -0,0 +1,83 @@
+#include "tick_store.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+TickStore::TickStore(const vector<string>& paths) {
+  for (const string& path : paths) {
+    unique_ptr<Segment> segment{new Segment};
+    segment->file.open(path);
+    CHECK (segment->file.is_open()) << "could not map " << path;
+    if (segment->file.size() % sizeof(Tick) != 0) {
+      LOG(WARNING) << path << " ends with a partial tick, ignoring it";
+    }
+    segment->ticks = reinterpret_cast<const Tick*>(segment->file.data());
+    segment->begin = size_;
+    segment->size = segment->file.size() / sizeof(Tick);
+    size_ += segment->size;
+    segments_.push_back(move(segment));
+  }
+}
+
+size_t TickStore::segment_of(uint64_t index) const {
+  auto after = upper_bound(
+      segments_.begin(), segments_.end(), index,
+      [](uint64_t i, const unique_ptr<Segment>& segment) {
+        return i < segment->begin;
+      });
+  return after == segments_.begin() ? 0 : after - segments_.begin() - 1;
+}
+
+uint64_t TickStore::lower_bound(uint64_t time) const {
+  uint64_t low = 0;
+  uint64_t high = size_;
+  while (low < high) {
+    const uint64_t mid = low + (high - low) / 2;
+    const Segment& segment = *segments_[segment_of(mid)];
+    if (tick_received(segment.ticks[mid - segment.begin]) < time) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+uint64_t TickStore::last_received() const {
+  if (size_ == 0) {
+    return 0;
+  }
+  const Segment& segment = *segments_[segment_of(size_ - 1)];
+  return tick_received(segment.ticks[size_ - 1 - segment.begin]);
+}
+
+TickStore::Reader::Reader(const TickStore& store, uint64_t begin)
+    : store_(store) {
+  const size_t segment = store.segment_of(begin);
+  enter(segment, segment < store.segments_.size()
+                 ? begin - store.segments_[segment]->begin : 0);
+}
+
+void TickStore::Reader::enter(size_t segment, uint64_t offset) {
+  for (; segment < store_.segments_.size(); ++segment, offset = 0) {
+    const Segment& s = *store_.segments_[segment];
+    if (offset < s.size) {
+      segment_ = segment;
+      next_ = s.ticks + offset;
+      end_ = s.ticks + s.size;
+      return;
+    }
+  }
+  segment_ = store_.segments_.size();
+  next_ = end_ = nullptr;
+}
+
+}  // namespace btc_arb
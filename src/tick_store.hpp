@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ticker_plant.hpp"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Flat tick files of one venue mapped read-only and addressed as a single
+// sequence of ticks. Files must be given in the order they were written.
+class TickStore {
+ public:
+  class Reader;
+
+  explicit TickStore(const std::vector<std::string>& paths);
+  TickStore(const TickStore&) = delete;
+
+  uint64_t size() const { return size_; }
+  // Index of the first tick received at or after time.
+  uint64_t lower_bound(uint64_t time) const;
+  // Receive time of the last tick, 0 if there is none.
+  uint64_t last_received() const;
+
+  // Calls visit(tick) on ticks [begin, end) until it returns false; returns
+  // the index of the first tick not visited.
+  template<typename Visitor>
+  uint64_t scan(uint64_t begin, uint64_t end, Visitor&& visit) const;
+
+ private:
+  struct Segment {
+    boost::iostreams::mapped_file_source file;
+    const Tick* ticks;
+    uint64_t begin;  // index of the segment's first tick
+    uint64_t size;
+  };
+
+  size_t segment_of(uint64_t index) const;
+
+  friend class Reader;
+
+  std::vector<std::unique_ptr<Segment>> segments_;
+  uint64_t size_ = 0;
+};
+
+template<typename Visitor>
+uint64_t TickStore::scan(uint64_t begin, uint64_t end, Visitor&& visit) const {
+  if (end > size_) {
+    end = size_;
+  }
+  uint64_t index = begin;
+  for (size_t s = segment_of(begin); index < end && s < segments_.size(); ++s) {
+    const Segment& segment = *segments_[s];
+    const uint64_t stop = std::min(end, segment.begin + segment.size);
+    for (; index < stop; ++index) {
+      if (!visit(segment.ticks[index - segment.begin])) {
+        return index;
+      }
+    }
+  }
+  return index;
+}
+
+// Reads a TickStore front to back, one tick at a time, for merging several
+// stores by time.
+class TickStore::Reader {
+ public:
+  explicit Reader(const TickStore& store, uint64_t begin = 0);
+
+  // Null once the store is exhausted.
+  const Tick* peek() const { return next_; }
+  inline void advance();
+
+ private:
+  void enter(size_t segment, uint64_t offset);
+
+  const TickStore& store_;
+  size_t segment_;
+  const Tick* next_;
+  const Tick* end_;
+};
+
+void TickStore::Reader::advance() {
+  if (++next_ == end_) {
+    enter(segment_ + 1, 0);
+  }
+}
+
+}  // namespace btc_arb
@@ -19,16 +19,87 @@ using namespace std;
 constexpr const char* EnumStrings<Currency>::names[];
 constexpr const char* EnumStrings<Quote::Type>::names[];
 constexpr const char* EnumStrings<Trade::Type>::names[];
+constexpr size_t RawMessage::MAX_SIZE;
+
+PlantMetrics& PlantMetrics::instance() {
+  MetricsRegistry& r = MetricsRegistry::instance();
+  static PlantMetrics metrics{
+    r.counter("btc_arb_messages_received_total",
+              "Messages received from live feeds"),
+    r.counter("btc_arb_parse_failures_total",
+              "Messages that could not be parsed into a tick"),
+    r.counter("btc_arb_ticks_total", "Ticks dispatched to handlers", "type=\"quote\""),
+    r.counter("btc_arb_ticks_total", "Ticks dispatched to handlers", "type=\"trade\""),
+    r.histogram("btc_arb_handler_duration_nanoseconds",
+                "Time spent in all tick handlers per tick, on sampled handler "
+                "calls"),
+    r.histogram("btc_arb_handler_batch_ticks",
+                "Ticks per handler call, on sampled handler calls"),
+    r.gauge("btc_arb_last_tick_received_seconds",
+            "Receive timestamp of the last dispatched tick"),
+    r.counter("btc_arb_sink_bytes_total", "Bytes written to file and socket sinks"),
+    r.gauge("btc_arb_ring_depth", "Messages queued between pipeline stages",
+            "stage=\"parse\""),
+    r.gauge("btc_arb_ring_depth", "Messages queued between pipeline stages",
+            "stage=\"handler\""),
+  };
+  return metrics;
+}
+
+TickerPlant::~TickerPlant() {
+#ifdef BTC_ARB_PERF_COUNTERS
+  report_perf();
+#endif
+}
 
 void TickerPlant::add_tick_handler(TickHandler&& handler) {
+  add_batch_handler(PerTickAdapter{move(handler)});
+}
+
+void TickerPlant::add_batch_handler(BatchHandler&& handler) {
   handlers_.emplace_back(move(handler));
+#ifdef BTC_ARB_PERF_COUNTERS
+  handler_perf_.emplace_back(
+      new PerfStats("handler[" + to_string(handlers_.size() - 1) + "]"));
+#endif
 }
 
+#ifdef BTC_ARB_PERF_COUNTERS
+void TickerPlant::report_perf() const {
+  parse_perf_.report();
+  for (const auto& stats : handler_perf_) {
+    stats->report();
+  }
+}
+#endif
+
 void TickerPlant::add_raw_handler(RawHandler&& handler) {
   raw_handlers_.emplace_back(move(handler));
 }
 
-FileLogger::FileLogger(const std::string& path_to_file) {
+void TickerPlant::add_frame_handler(FrameHandler&& handler) {
+  frame_handlers_.emplace_back(move(handler));
+}
+
+template<>
+bool FileTickerPlant<FlatParser>::run() {
+  CHECK (file_.is_open()) << "file not open";
+  vector<Tick> batch(TICK_BATCH_SIZE);
+  while (file_) {
+    size_t count = 0;
+    {
+      PERF_SCOPE_N(parse_perf_, count);
+      count = parse_batch(file_, batch.data(), batch.size());
+    }
+    if (count > 0) {
+      call_handlers(TickSpan{batch.data(), count});
+    }
+  }
+  return true;
+}
+
+FileLogger::FileLogger(const std::string& path_to_file)
+    : bytes_(&PlantMetrics::instance().sink_bytes) {
   file_.reset(new std::ofstream());
   file_->open(path_to_file, std::ios::out | std::ios::app);
 }
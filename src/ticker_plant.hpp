@@ -1,6 +1,12 @@
 #pragma once
 
 #include "enum_utils.hpp"
+#include "event_log.hpp"
+#include "low_latency.hpp"
+#include "metrics.hpp"
+#include "perf_counters.hpp"
+#include "raw_capture.hpp"
+#include "spsc_ring.hpp"
 
 #include <boost/optional.hpp>
 #include <glog/logging.h>
@@ -10,15 +16,27 @@
 #include <websocketpp/config/asio_no_tls_client.hpp>
 #include <websocketpp/client.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <cstdint>
+#include <thread>
 #include <vector>
 
 namespace btc_arb {
 constexpr int VOLUME_MULTIPLIER = 100000000;  // 1E8
+constexpr uint64_t LAG_REPORT_COUNT = 100000;
+constexpr uint64_t RING_GAUGE_INTERVAL = 1024;
+// Handler time is measured on one handler call in this many, so the live
+// path does not read the clock twice per tick.
+constexpr uint64_t HANDLER_TIMING_INTERVAL = 16;
+// Most ticks handed to batch handlers at once.
+constexpr size_t TICK_BATCH_SIZE = 1024;
 
 enum class Currency {
   USD, EUR, GBP, JPY, BTC
@@ -111,25 +129,146 @@ template<> struct Tick::ContentInd<Trade> {
   static constexpr Type CONTENT_TYPE = Type::TRADE;
 };
 
+inline uint64_t tick_ex_time(const Tick& tick) {
+  switch (tick.type) {
+    case Tick::Type::QUOTE: return tick.as<Quote>().ex_time;
+    case Tick::Type::TRADE: return tick.as<Trade>().ex_time;
+    default: return 0;
+  }
+}
+
+inline uint64_t tick_received(const Tick& tick) {
+  switch (tick.type) {
+    case Tick::Type::QUOTE: return tick.as<Quote>().received;
+    case Tick::Type::TRADE: return tick.as<Trade>().received;
+    default: return 0;
+  }
+}
+
+inline Currency tick_currency(const Tick& tick) {
+  return tick.type == Tick::Type::TRADE ? tick.as<Trade>().cyc
+                                        : tick.as<Quote>().cyc;
+}
+
+// Contiguous ticks, valid for the duration of a handler call.
+struct TickSpan {
+  const Tick* ticks;
+  size_t size;
+
+  const Tick* begin() const { return ticks; }
+  const Tick* end() const { return ticks + size; }
+};
+
 using TickHandler = std::function<void(const Tick&)>;
+using BatchHandler = std::function<void(TickSpan)>;
 using RawHandler = std::function<void(const std::string&)>;
 
+// Runs a per-tick handler over every tick of a batch.
+class PerTickAdapter {
+ public:
+  explicit PerTickAdapter(TickHandler&& handler) : handler_(std::move(handler)) {}
+
+  void operator() (TickSpan ticks) const {
+    for (const Tick& tick : ticks) {
+      handler_(tick);
+    }
+  }
+
+ private:
+  TickHandler handler_;
+};
+
+// Metrics shared by every plant, registered with MetricsRegistry on first use.
+struct PlantMetrics {
+  static PlantMetrics& instance();
+
+  Counter& messages;
+  Counter& parse_failures;
+  Counter& quotes;
+  Counter& trades;
+  Histogram& handler_ns;
+  Histogram& handler_batch_ticks;
+  Gauge& last_tick;
+  Counter& sink_bytes;
+  Gauge& raw_ring_depth;
+  Gauge& tick_ring_depth;
+};
+
 class TickerPlant {
  public:
+  TickerPlant() : metrics_(PlantMetrics::instance()) {}
+  virtual ~TickerPlant();
+
+  // Tick handlers are run through a PerTickAdapter; batch handlers get
+  // whole runs of ticks where the plant has them (flat files, a backed up
+  // ring) and single ticks otherwise. Handlers run in the order added.
   void add_tick_handler(TickHandler&& handler);
+  void add_batch_handler(BatchHandler&& handler);
   void add_raw_handler(RawHandler&& handler);
+  // Frame handlers see each message exactly as received, before parsing.
+  void add_frame_handler(FrameHandler&& handler);
   virtual bool run() = 0;
  protected:
   inline void call_handlers(const Tick& tick);
+  inline void call_handlers(TickSpan ticks);
   inline void call_raw_handlers(const std::string& msg);
+  inline void call_frame_handlers(const RawFrame& frame);
 
-  std::vector<TickHandler> handlers_;
+  std::vector<BatchHandler> handlers_;
   std::vector<RawHandler> raw_handlers_;
+  std::vector<FrameHandler> frame_handlers_;
+  PlantMetrics& metrics_;
+  uint64_t handler_calls_ = 0;
+#ifdef BTC_ARB_PERF_COUNTERS
+  void report_perf() const;
+
+  std::vector<std::unique_ptr<PerfStats>> handler_perf_;
+  PerfStats parse_perf_{"parse"};
+  uint64_t perf_ticks_ = 0;
+#endif
 };
 
 void TickerPlant::call_handlers(const Tick& tick) {
-  for(auto& handler : handlers_) {
-    handler(tick);
+  call_handlers(TickSpan{&tick, 1});
+}
+
+void TickerPlant::call_handlers(TickSpan ticks) {
+  const bool timed =
+      handler_calls_++ % HANDLER_TIMING_INTERVAL == 0 && ticks.size > 0;
+  std::chrono::steady_clock::time_point start;
+  if (timed) {
+    start = std::chrono::steady_clock::now();
+  }
+  for (size_t i = 0; i < handlers_.size(); ++i) {
+    PERF_SCOPE_N(*handler_perf_[i], ticks.size);
+    handlers_[i](ticks);
+  }
+#ifdef BTC_ARB_PERF_COUNTERS
+  const uint64_t reports = perf_ticks_ / PERF_REPORT_COUNT;
+  perf_ticks_ += ticks.size;
+  if (perf_ticks_ / PERF_REPORT_COUNT != reports) {
+    report_perf();
+  }
+#endif
+  if (timed) {
+    // Per tick, so single ticks and full batches share one scale.
+    metrics_.handler_ns.observe(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / ticks.size);
+    metrics_.handler_batch_ticks.observe(ticks.size);
+  }
+  uint64_t counts[3] = {};  // by Tick::Type
+  for (const Tick& tick : ticks) {
+    ++counts[static_cast<size_t>(tick.type)];
+  }
+  if (counts[static_cast<size_t>(Tick::Type::QUOTE)] > 0) {
+    metrics_.quotes.inc(counts[static_cast<size_t>(Tick::Type::QUOTE)]);
+  }
+  if (counts[static_cast<size_t>(Tick::Type::TRADE)] > 0) {
+    metrics_.trades.inc(counts[static_cast<size_t>(Tick::Type::TRADE)]);
+  }
+  if (ticks.size > 0) {
+    metrics_.last_tick.set(tick_received(ticks.ticks[ticks.size - 1]) / 1E9);
   }
 }
 
@@ -139,6 +278,12 @@ void TickerPlant::call_raw_handlers(const std::string& msg) {
   }
 }
 
+void TickerPlant::call_frame_handlers(const RawFrame& frame) {
+  for(auto& handler : frame_handlers_) {
+    handler(frame);
+  }
+}
+
 struct ParsedTick {
   Tick tick;
   std::string raw;
@@ -153,6 +298,27 @@ class FlatParser {
     }
     return boost::optional<const ParsedTick>{};
   }
+
+  // Reads up to max ticks into ticks; returns how many were read.
+  inline size_t parse_batch(std::istream& stream, Tick* ticks, size_t max) {
+    stream.read(reinterpret_cast<char*>(ticks), max * sizeof(Tick));
+    return stream.gcount() / sizeof(Tick);
+  }
+};
+
+// Payload copied off the socket by the network thread in low-latency mode.
+// Payloads over MAX_SIZE go to a heap copy owned by the message instead.
+struct RawMessage {
+  static constexpr size_t MAX_SIZE = 8192;
+
+  const char* payload() const { return overflow ? overflow : data; }
+
+  uint64_t received;
+  uint64_t mono;
+  uint32_t connection;
+  uint32_t size;
+  char* overflow;
+  char data[MAX_SIZE];
 };
 
 template<typename Parser>
@@ -161,46 +327,262 @@ class WebSocketTickerPlant : public TickerPlant, Parser {
   using ws_client = websocketpp::client<websocketpp::config::asio_client>;
   using message_ptr = websocketpp::config::asio_client::message_type::ptr;
 
-  WebSocketTickerPlant(const std::string& uri_);
+  WebSocketTickerPlant(const std::string& uri_,
+                       const LowLatencyConfig& config = LowLatencyConfig{});
 
   WebSocketTickerPlant(const WebSocketTickerPlant&) = delete;
 
   virtual bool run() override;
+
+  // Exchange stamp to handler dispatch, in microseconds. This is feed lag
+  // including clock skew to the exchange, not thread wakeup latency.
+  const LatencyHistogram& dispatch_lag() const { return dispatch_lag_; }
  private:
+  void connect();
+  bool run_low_latency();
+  void parse_loop();
+  void handler_loop();
   inline void dispatcher(websocketpp::connection_hdl hdl, message_ptr msg);
+  inline void enqueue(websocketpp::connection_hdl hdl, message_ptr msg);
+  inline void dispatch(const ParsedTick& parsed);
+  inline void record_lag(const Tick& tick);
 
   const std::string uri_;
+  const LowLatencyConfig config_;
   ws_client client_;
+  LatencyHistogram dispatch_lag_;
+
+  std::unique_ptr<SpscRing<RawMessage>> raw_ring_;
+  std::unique_ptr<SpscRing<ParsedTick>> tick_ring_;
+  std::atomic<bool> network_done_{false};
+  std::atomic<bool> parse_done_{false};
+  uint32_t connection_ = 0;  // counts connects, stamped on raw frames
 };
 
 template<typename Parser>
-WebSocketTickerPlant<Parser>::WebSocketTickerPlant(const std::string& uri)
-    : uri_(uri) {
+WebSocketTickerPlant<Parser>::WebSocketTickerPlant(
+    const std::string& uri, const LowLatencyConfig& config)
+    : uri_(uri), config_(config) {
   client_.init_asio();
+  if (config_.so_busy_poll_usec > 0) {
+    const int usec = config_.so_busy_poll_usec;
+    client_.set_socket_init_handler(
+        [usec](websocketpp::connection_hdl, boost::asio::ip::tcp::socket& s) {
+          set_socket_busy_poll(s.native_handle(), usec);
+        });
+  }
 }
 
 template<typename Parser>
-bool WebSocketTickerPlant<Parser>::run() {
-  client_.set_message_handler(
-      bind(&WebSocketTickerPlant::dispatcher, this, _1, _2));
+void WebSocketTickerPlant<Parser>::connect() {
   websocketpp::lib::error_code ec;
   ws_client::connection_ptr conn = client_.get_connection(uri_, ec);
   conn->replace_header("Origin", uri_);
+  ++connection_;
   client_.connect(conn);
+}
+
+template<typename Parser>
+bool WebSocketTickerPlant<Parser>::run() {
+  if (config_.lock_memory) {
+    lock_process_memory();
+  }
+  if (config_.busy_poll) {
+    return run_low_latency();
+  }
+  client_.set_message_handler(
+      bind(&WebSocketTickerPlant::dispatcher, this, _1, _2));
+  connect();
   client_.run();
+  dispatch_lag_.report("exchange_to_dispatch_us[default]");
   return true;
 }
 
+// Network, parse and handler stages each get their own (optionally pinned)
+// thread, connected by SPSC rings. Every stage spins instead of sleeping.
+template<typename Parser>
+bool WebSocketTickerPlant<Parser>::run_low_latency() {
+  raw_ring_.reset(new SpscRing<RawMessage>(config_.ring_size));
+  tick_ring_.reset(new SpscRing<ParsedTick>(config_.ring_size));
+  if (config_.lock_memory) {
+    // Raw payloads live inline in their slots; the re-serialized raw
+    // strings get their capacity now, written so the pages are mapped, and
+    // keep it across laps.
+    raw_ring_->prefault();
+    tick_ring_->prefault([](ParsedTick& slot) {
+        slot.raw.assign(RawMessage::MAX_SIZE, '\0');
+        slot.raw.clear();
+      });
+  }
+  network_done_ = false;
+  parse_done_ = false;
+
+  std::thread parse_thread{&WebSocketTickerPlant::parse_loop, this};
+  std::thread handler_thread{&WebSocketTickerPlant::handler_loop, this};
+
+  pin_current_thread(config_.network_cpu);
+  client_.set_message_handler(
+      bind(&WebSocketTickerPlant::enqueue, this, _1, _2));
+  connect();
+  while (!client_.stopped()) {
+    if (client_.poll() == 0) {
+      cpu_relax();
+    }
+  }
+  network_done_ = true;
+  parse_thread.join();
+  handler_thread.join();
+  dispatch_lag_.report("exchange_to_dispatch_us[busy_poll]");
+  return true;
+}
+
+template<typename Parser>
+void WebSocketTickerPlant<Parser>::enqueue(
+    websocketpp::connection_hdl hdl, message_ptr msg) {
+  metrics_.messages.inc();
+  const std::string& payload = msg->get_payload();
+  RawMessage* slot;
+  while ((slot = raw_ring_->next_slot()) == nullptr) {
+    cpu_relax();
+  }
+  slot->received = std::chrono::system_clock::now().time_since_epoch().count();
+  slot->mono = mono_now();
+  slot->connection = connection_;
+  slot->size = payload.size();
+  slot->overflow = nullptr;
+  if (payload.size() > RawMessage::MAX_SIZE) {
+    // Rare (snapshots); allocating here beats losing the message.
+    EVENT_LOG(WARNING, "copying message of {} bytes, larger than {}, to the "
+              "heap", payload.size(), RawMessage::MAX_SIZE);
+    slot->overflow = new char[payload.size()];
+  }
+  std::memcpy(slot->overflow ? slot->overflow : slot->data, payload.data(),
+              payload.size());
+  raw_ring_->commit();
+}
+
+template<typename Parser>
+void WebSocketTickerPlant<Parser>::parse_loop() {
+  pin_current_thread(config_.parse_cpu);
+  uint64_t popped = 0;
+  while (true) {
+    RawMessage* msg = raw_ring_->front();
+    if (msg == nullptr) {
+      if (network_done_.load(std::memory_order_acquire) &&
+          raw_ring_->front() == nullptr) {
+        break;
+      }
+      cpu_relax();
+      continue;
+    }
+    call_frame_handlers(RawFrame{msg->mono, msg->received, msg->connection,
+                                 msg->size, msg->payload()});
+    PayloadBuf payload{msg->payload(), msg->size};
+    std::istream stream{&payload};
+    boost::optional<ParsedTick> parsed;
+    {
+      PERF_SCOPE(parse_perf_);
+      parsed = Parser::parse(stream, msg->received);
+    }
+    delete[] msg->overflow;
+    raw_ring_->pop();
+    if (++popped % RING_GAUGE_INTERVAL == 0) {
+      metrics_.raw_ring_depth.set(raw_ring_->size());
+    }
+    if (!parsed) {
+      EVENT_LOG(INFO, "un-handled event");
+      continue;
+    }
+    ParsedTick* slot;
+    while ((slot = tick_ring_->next_slot()) == nullptr) {
+      cpu_relax();
+    }
+    slot->tick = (*parsed).tick;
+    slot->raw.assign((*parsed).raw);
+    tick_ring_->commit();
+  }
+  parse_done_.store(true, std::memory_order_release);
+}
+
+template<typename Parser>
+void WebSocketTickerPlant<Parser>::handler_loop() {
+  pin_current_thread(config_.handler_cpu);
+  // Drains whatever the ring holds, up to a batch, so handlers see single
+  // ticks when keeping up and runs of ticks when catching up. Raw handlers
+  // run right after their message's tick, as in the default mode, so with
+  // any registered every tick goes out on its own.
+  const bool per_message = !raw_handlers_.empty();
+  std::vector<Tick> batch(TICK_BATCH_SIZE);
+  uint64_t popped = 0;
+  while (true) {
+    size_t count = 0;
+    ParsedTick* parsed;
+    while (count < batch.size() && (parsed = tick_ring_->front()) != nullptr) {
+      record_lag(parsed->tick);
+      batch[count++] = parsed->tick;
+      if (per_message) {
+        call_handlers(parsed->tick);
+        call_raw_handlers(parsed->raw);
+      }
+      tick_ring_->pop();
+      if (++popped % RING_GAUGE_INTERVAL == 0) {
+        metrics_.tick_ring_depth.set(tick_ring_->size());
+      }
+    }
+    if (count == 0) {
+      if (parse_done_.load(std::memory_order_acquire) &&
+          tick_ring_->front() == nullptr) {
+        break;
+      }
+      cpu_relax();
+      continue;
+    }
+    if (!per_message) {
+      call_handlers(TickSpan{batch.data(), count});
+    }
+  }
+}
+
 template<typename Parser>
 void WebSocketTickerPlant<Parser>::dispatcher(
     websocketpp::connection_hdl hdl, message_ptr msg) {
-  std::stringstream stream{msg->get_payload()};
-  boost::optional<const ParsedTick> parsed = Parser::parse(stream);
+  metrics_.messages.inc();
+  const std::string& payload = msg->get_payload();
+  const uint64_t received =
+      std::chrono::system_clock::now().time_since_epoch().count();
+  call_frame_handlers(RawFrame{mono_now(), received, connection_,
+                               static_cast<uint32_t>(payload.size()),
+                               payload.data()});
+  PayloadBuf buf{payload.data(), payload.size()};
+  std::istream stream{&buf};
+  boost::optional<ParsedTick> parsed;
+  {
+    PERF_SCOPE(parse_perf_);
+    parsed = Parser::parse(stream, received);
+  }
   if (parsed) {
-    call_handlers((*parsed).tick);
-    call_raw_handlers((*parsed).raw);
+    dispatch(*parsed);
   } else {
-    LOG(INFO) << "un-handled event";
+    EVENT_LOG(INFO, "un-handled event");
+  }
+}
+
+template<typename Parser>
+void WebSocketTickerPlant<Parser>::dispatch(const ParsedTick& parsed) {
+  record_lag(parsed.tick);
+  call_handlers(parsed.tick);
+  call_raw_handlers(parsed.raw);
+}
+
+template<typename Parser>
+void WebSocketTickerPlant<Parser>::record_lag(const Tick& tick) {
+  const uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  const uint64_t ex_time = tick_ex_time(tick);
+  dispatch_lag_.record(now_us > ex_time ? now_us - ex_time : 0);
+  if (dispatch_lag_.count() % LAG_REPORT_COUNT == 0) {
+    dispatch_lag_.report(config_.busy_poll ? "exchange_to_dispatch_us[busy_poll]"
+                                           : "exchange_to_dispatch_us[default]");
   }
 }
 
@@ -220,19 +602,89 @@ FileTickerPlant<Parser>::FileTickerPlant(const std::string& path_to_file) {
     file_.open(path_to_file, std::ios::in | std::ios::binary);
 }
 
+// Ticks are handed to the handlers in batches of TICK_BATCH_SIZE.
 template<typename Parser>
 bool FileTickerPlant<Parser>::run() {
     CHECK (file_.is_open()) << "file not open";
+    std::vector<Tick> batch;
+    batch.reserve(TICK_BATCH_SIZE);
     boost::optional<ParsedTick> parsed;
     while (file_) {
-        parsed = Parser::parse(file_);
+        {
+          PERF_SCOPE(parse_perf_);
+          parsed = Parser::parse(file_);
+        }
         if (parsed) {
-            call_handlers((*parsed).tick);
+            batch.push_back((*parsed).tick);
+            if (batch.size() == TICK_BATCH_SIZE) {
+                call_handlers(TickSpan{batch.data(), batch.size()});
+                batch.clear();
+            }
         }
     }
+    if (!batch.empty()) {
+        call_handlers(TickSpan{batch.data(), batch.size()});
+    }
     return true;
 }
 
+// Flat files are read a batch at a time, straight into the batch.
+template<>
+bool FileTickerPlant<FlatParser>::run();
+
+// Replays a raw capture through the parser. The path is
+// "<file>[#<wall ns>]" to start from the first frame received at or after
+// that time. Frame handlers get the frames unchanged, so re-capturing a
+// replay reproduces the file.
+template<typename Parser>
+class RawCaptureTickerPlant : public TickerPlant, Parser {
+ public:
+  RawCaptureTickerPlant(const std::string& path);
+  RawCaptureTickerPlant(const RawCaptureTickerPlant&) = delete;
+
+  virtual bool run() override;
+ private:
+  static std::string file_of(const std::string& path);
+
+  RawCaptureReader reader_;
+  uint64_t start_ = 0;
+};
+
+template<typename Parser>
+std::string RawCaptureTickerPlant<Parser>::file_of(const std::string& path) {
+  return path.substr(0, path.find('#'));
+}
+
+template<typename Parser>
+RawCaptureTickerPlant<Parser>::RawCaptureTickerPlant(const std::string& path)
+    : reader_(file_of(path)) {
+  const std::string::size_type delim = path.find('#');
+  if (delim != std::string::npos) {
+    start_ = std::stoull(path.substr(delim + 1));
+  }
+}
+
+template<typename Parser>
+bool RawCaptureTickerPlant<Parser>::run() {
+  reader_.seek(start_);
+  RawFrame frame;
+  boost::optional<ParsedTick> parsed;
+  while (reader_.next(frame)) {
+    call_frame_handlers(frame);
+    PayloadBuf payload{frame.data, frame.size};
+    std::istream stream{&payload};
+    {
+      PERF_SCOPE(parse_perf_);
+      parsed = Parser::parse(stream, frame.wall);
+    }
+    if (parsed) {
+      call_handlers((*parsed).tick);
+      call_raw_handlers((*parsed).raw);
+    }
+  }
+  return true;
+}
+
 class FileLogger {
  public:
   FileLogger(const std::string& path_to_file);
@@ -245,16 +697,19 @@ class FileLogger {
   inline void log(const Tick& tick);
  private:
   std::shared_ptr<std::ofstream> file_;
+  Counter* bytes_;
 };
 
 void FileLogger::log(const char* tick, size_t size) {
   CHECK (file_->is_open()) << "file not open";
   file_->write(tick, size);
+  bytes_->inc(size);
 }
 
 void FileLogger::log(const std::string& msg) {
   CHECK (file_->is_open()) << "file not open";
   (*file_) << msg;
+  bytes_->inc(msg.size());
 }
 
 void FileLogger::log(const Tick& tick) {
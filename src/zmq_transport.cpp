@@ -0,0 +1,239 @@
+#include "zmq_transport.hpp"
+#include "event_log.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace btc_arb {
+
+using namespace std;
+
+namespace {
+constexpr int ZMQ_IO_THREADS = 1;
+constexpr uint64_t MAX_IDLE_SLEEP_US = 100;
+constexpr size_t NUM_TICK_TYPES = 2;  // quote, trade
+
+const char* tick_type_name(Tick::Type type) {
+  return type == Tick::Type::QUOTE ? "quote" : "trade";
+}
+}  // anonymous namespace
+
+ZmqPublisher::Batch* ZmqPublisher::BatchPool::acquire() {
+  lock_guard<mutex> guard(mutex_);
+  if (free_.empty()) {
+    all_.emplace_back(new Batch(this, batch_ticks_));
+    return all_.back().get();
+  }
+  Batch* batch = free_.back();
+  free_.pop_back();
+  return batch;
+}
+
+void ZmqPublisher::BatchPool::release(Batch* batch) {
+  batch->size = 0;
+  lock_guard<mutex> guard(mutex_);
+  free_.push_back(batch);
+}
+
+void ZmqPublisher::release_batch(void* data, void* hint) {
+  Batch* batch = static_cast<Batch*>(hint);
+  batch->pool->release(batch);
+}
+
+uint64_t ZmqPublisher::now_us() {
+  return chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+constexpr int ZmqPublisher::LINGER_MS;
+
+ZmqPublisher::ZmqPublisher(const string& endpoint, const string& venue,
+                           const ZmqPublisherConfig& config)
+    : config_(config), bytes_(&PlantMetrics::instance().sink_bytes),
+      pool_(max<size_t>(1, config.max_batch_ticks)),
+      context_(ZMQ_IO_THREADS), socket_(context_, ZMQ_PUB),
+      batches_(enum_size<Currency>() * NUM_TICK_TYPES, nullptr),
+      queue_(config.queue_size), running_(true) {
+  for (size_t cyc = 0; cyc < enum_size<Currency>(); ++cyc) {
+    for (Tick::Type type : {Tick::Type::QUOTE, Tick::Type::TRADE}) {
+      topics_.push_back(venue + "." + enum_name(static_cast<Currency>(cyc)) +
+                        "." + tick_type_name(type));
+    }
+  }
+  socket_.setsockopt(ZMQ_LINGER, &LINGER_MS, sizeof(LINGER_MS));
+  socket_.bind(endpoint.c_str());
+  thread_ = thread(&ZmqPublisher::run, this);
+}
+
+ZmqPublisher::~ZmqPublisher() {
+  running_ = false;
+  thread_.join();
+  socket_.close();
+}
+
+size_t ZmqPublisher::topic_index(const Tick& tick) const {
+  return static_cast<size_t>(tick_currency(tick)) * NUM_TICK_TYPES +
+      (tick.type == Tick::Type::TRADE ? 1 : 0);
+}
+
+void ZmqPublisher::run() {
+  const uint64_t idle_sleep_us =
+      min(MAX_IDLE_SLEEP_US, config_.max_batch_delay_us / 4 + 1);
+  const size_t max_ticks = max<size_t>(1, config_.max_batch_ticks);
+  while (true) {
+    const Tick* tick = queue_.front();
+    const uint64_t now = now_us();
+    if (tick != nullptr) {
+      if (tick->type != Tick::Type::EMPTY) {
+        const size_t topic = topic_index(*tick);
+        Batch*& batch = batches_[topic];
+        if (batch == nullptr) {
+          batch = pool_.acquire();
+          batch->opened = now;
+        }
+        batch->ticks[batch->size++] = *tick;
+        if (batch->size == max_ticks || config_.max_batch_delay_us == 0) {
+          flush(topic);
+        }
+      }
+      queue_.pop();
+    } else if (!running_) {
+      break;
+    }
+    for (size_t topic = 0; topic < batches_.size(); ++topic) {
+      if (batches_[topic] != nullptr &&
+          now - batches_[topic]->opened >= config_.max_batch_delay_us) {
+        flush(topic);
+      }
+    }
+    if (tick == nullptr) {
+      this_thread::sleep_for(chrono::microseconds(idle_sleep_us));
+    }
+  }
+  for (size_t topic = 0; topic < batches_.size(); ++topic) {
+    if (batches_[topic] != nullptr) {
+      flush(topic);
+    }
+  }
+}
+
+void ZmqPublisher::flush(size_t topic) {
+  Batch* batch = batches_[topic];
+  batches_[topic] = nullptr;
+  zmq::message_t topic_msg(topics_[topic].size());
+  memcpy(topic_msg.data(), topics_[topic].data(), topics_[topic].size());
+  const size_t bytes = batch->size * sizeof(Tick);
+  zmq::message_t payload(batch->ticks.data(), bytes,
+                         &ZmqPublisher::release_batch, batch);
+  socket_.send(topic_msg, ZMQ_SNDMORE);
+  socket_.send(payload);
+  bytes_->inc(bytes);
+}
+
+constexpr int ZmqTickerPlant::RECV_TIMEOUT_MS;
+constexpr uint32_t ZmqTickerPlant::MAX_RECV_ERRORS;
+
+namespace {
+string topic_venue(const char* topic, size_t size) {
+  const char* dot = static_cast<const char*>(memchr(topic, '.', size));
+  return string(topic, dot == nullptr ? size : dot - topic);
+}
+}  // anonymous namespace
+
+ZmqTickerPlant::ZmqTickerPlant(const string& path)
+    : context_(ZMQ_IO_THREADS), socket_(context_, ZMQ_SUB) {
+  const string::size_type hash = path.find('#');
+  const string endpoint = path.substr(0, hash);
+  const string prefix = hash == string::npos ? "" : path.substr(hash + 1);
+  // "mtgox." or "mtgox.usd" pins the venue; "mtg" does not.
+  if (prefix.find('.') != string::npos) {
+    venue_ = topic_venue(prefix.data(), prefix.size());
+  }
+  socket_.setsockopt(ZMQ_RCVTIMEO, &RECV_TIMEOUT_MS, sizeof(RECV_TIMEOUT_MS));
+  socket_.connect(endpoint.c_str());
+  socket_.setsockopt(ZMQ_SUBSCRIBE, prefix.data(), prefix.size());
+}
+
+const string& ZmqTickerPlant::venue() {
+  if (!venue_.empty() || pending_topic_) {
+    return venue_;
+  }
+  unique_ptr<zmq::message_t> topic{new zmq::message_t};
+  unique_ptr<zmq::message_t> payload{new zmq::message_t};
+  while (running_ && recv_errors_ < MAX_RECV_ERRORS) {
+    if (receive(*topic, *payload)) {
+      venue_ = topic_venue(static_cast<const char*>(topic->data()),
+                           topic->size());
+      pending_topic_ = move(topic);
+      pending_payload_ = move(payload);
+      break;
+    }
+  }
+  return venue_;
+}
+
+bool ZmqTickerPlant::receive(zmq::message_t& topic, zmq::message_t& payload) {
+  try {
+    // Parts of a message arrive together, so only the topic can time out.
+    if (!socket_.recv(&topic)) {
+      return false;
+    }
+    if (!socket_.recv(&payload)) {
+      throw runtime_error("topic without a payload");
+    }
+  } catch (const exception& e) {
+    ++recv_errors_;
+    EVENT_LOG(ERROR, "zmq receive failed ({} in a row): {}", recv_errors_,
+              e.what());
+    return false;
+  }
+  recv_errors_ = 0;
+  return true;
+}
+
+void ZmqTickerPlant::replay(zmq::message_t& topic, zmq::message_t& payload) {
+  metrics_.messages.inc();
+  if (!venue_.empty() &&
+      topic_venue(static_cast<const char*>(topic.data()), topic.size()) !=
+      venue_) {
+    EVENT_LOG(WARNING, "zmq message from another venue than {}, relabelled",
+              venue_);
+  }
+  if (payload.size() % sizeof(Tick) != 0) {
+    EVENT_LOG(WARNING, "dropping zmq payload of {} bytes, not a whole number "
+              "of ticks", payload.size());
+    metrics_.parse_failures.inc();
+    return;
+  }
+  // Copied out since the payload need not be aligned for Tick.
+  batch_.resize(payload.size() / sizeof(Tick));
+  memcpy(batch_.data(), payload.data(), payload.size());
+  call_handlers(TickSpan{batch_.data(), batch_.size()});
+}
+
+bool ZmqTickerPlant::run() {
+  if (pending_topic_) {
+    replay(*pending_topic_, *pending_payload_);
+    pending_topic_.reset();
+    pending_payload_.reset();
+  }
+  zmq::message_t topic;
+  zmq::message_t payload;
+  while (running_) {
+    if (receive(topic, payload)) {
+      replay(topic, payload);
+    } else if (recv_errors_ >= MAX_RECV_ERRORS) {
+      LOG(ERROR) << "giving up on zmq after " << recv_errors_
+                 << " receive errors in a row";
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace btc_arb
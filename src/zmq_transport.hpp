@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ticker_plant.hpp"
+#include "spsc_ring.hpp"
+
+#include <zmq.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace btc_arb {
+
+// Ticks go out as two-part messages: a topic "<venue>.<currency>.<type>",
+// e.g. "mtgox.usd.quote", so subscribers can filter by prefix, and a
+// payload of one or more Tick structs back to back, as in the flat format.
+
+struct ZmqPublisherConfig {
+  uint64_t max_batch_delay_us = 1000;  // 0 publishes every tick on its own
+  size_t max_batch_ticks = 64;
+  size_t queue_size = 1 << 14;  // ticks buffered between handler and publisher
+};
+
+// Tick sink publishing on a PUB socket. The handler thread only copies the
+// tick into a ring; a background thread batches per topic, holding a batch
+// no longer than max_batch_delay_us, and hands the batch buffer to zmq
+// without copying it. Sent payload bytes count towards
+// btc_arb_sink_bytes_total.
+class ZmqPublisher {
+ public:
+  // How long closing waits for queued messages to reach subscribers before
+  // dropping them, so a stuck peer cannot hold up shutdown.
+  static constexpr int LINGER_MS = 1000;
+
+  ZmqPublisher(const std::string& endpoint, const std::string& venue,
+               const ZmqPublisherConfig& config = ZmqPublisherConfig{});
+  ~ZmqPublisher();
+
+  ZmqPublisher(const ZmqPublisher&) = delete;
+
+  inline void publish(const Tick& tick);
+
+ private:
+  class BatchPool;
+
+  struct Batch {
+    Batch(BatchPool* pool_, size_t capacity) : pool(pool_), ticks(capacity) {}
+    BatchPool* pool;
+    std::vector<Tick> ticks;
+    size_t size = 0;
+    uint64_t opened = 0;  // steady clock, us
+  };
+
+  // Sent batches come back from zmq's I/O thread once the message is
+  // released, so the pool is locked.
+  class BatchPool {
+   public:
+    explicit BatchPool(size_t batch_ticks) : batch_ticks_(batch_ticks) {}
+    Batch* acquire();
+    void release(Batch* batch);
+   private:
+    const size_t batch_ticks_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Batch>> all_;
+    std::vector<Batch*> free_;
+  };
+
+  static void release_batch(void* data, void* hint);
+  static uint64_t now_us();
+
+  void run();
+  void flush(size_t topic);
+  inline size_t topic_index(const Tick& tick) const;
+
+  const ZmqPublisherConfig config_;
+  Counter* bytes_;
+  BatchPool pool_;  // outlives context_, whose teardown releases messages
+  zmq::context_t context_;
+  zmq::socket_t socket_;
+  std::vector<std::string> topics_;
+  std::vector<Batch*> batches_;
+  SpscRing<Tick> queue_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+void ZmqPublisher::publish(const Tick& tick) {
+  Tick* slot;
+  while ((slot = queue_.next_slot()) == nullptr) {
+    cpu_relax();
+  }
+  *slot = tick;
+  queue_.commit();
+}
+
+// Subscribes to a ZmqPublisher and replays its ticks to the handlers. The
+// path is "<endpoint>[#<topic prefix>]", e.g. tcp://host:5556#mtgox.usd.
+//
+// run() returns true once stop() is called, and false after
+// MAX_RECV_ERRORS receive errors in a row.
+class ZmqTickerPlant : public TickerPlant {
+ public:
+  static constexpr int RECV_TIMEOUT_MS = 100;
+  static constexpr uint32_t MAX_RECV_ERRORS = 100;
+
+  ZmqTickerPlant(const std::string& path);
+  ZmqTickerPlant(const ZmqTickerPlant&) = delete;
+
+  virtual bool run() override;
+  // Safe from any thread and from signal handlers.
+  void stop() { running_ = false; }
+
+  // Venue of the upstream publisher, from the topic prefix when it names
+  // one and otherwise from the first message's topic, which blocks until
+  // a message arrives. Empty if stopped before that.
+  const std::string& venue();
+ private:
+  // Receives one topic and payload; false on timeout, stop or error.
+  bool receive(zmq::message_t& topic, zmq::message_t& payload);
+  void replay(zmq::message_t& topic, zmq::message_t& payload);
+
+  zmq::context_t context_;
+  zmq::socket_t socket_;
+  std::atomic<bool> running_{true};
+  uint32_t recv_errors_ = 0;
+  std::string venue_;
+  // Message read by venue() before run(), replayed first.
+  std::unique_ptr<zmq::message_t> pending_topic_;
+  std::unique_ptr<zmq::message_t> pending_payload_;
+  std::vector<Tick> batch_;
+};
+
+}  // namespace btc_arb